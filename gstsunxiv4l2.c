@@ -1,4 +1,6 @@
 #include <stdio.h>
+#include <errno.h>
+#include <poll.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <string.h>
@@ -8,6 +10,7 @@
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <linux/videodev2.h>
+#include <linux/dma-buf.h>
 
 #include <gst/gst.h>
 #include <gst/video/gstvideometa.h>
@@ -28,10 +31,20 @@ struct _SunxiV4l2camer_mem_block {
     gboolean initialized;
     gboolean used;
     struct v4l2_buffer v4l2_buf;
+    gint nplanes;
+    gint fd;
+    gint prot;
+    guint32 offset[3];  /* mmap offset, planes are mapped on first CPU access */
     gpointer start[3];
     size_t len[3];
+    gint dmafd[3];
 };
 
+/* who has a V4L2 buffer, so a stream restart knows what to queue */
+#define SUNXI_V4L2_BUF_IDLE 0
+#define SUNXI_V4L2_BUF_QUEUED 1
+#define SUNXI_V4L2_BUF_DEQUEUED 2
+
 typedef struct _SunxiV4l2cameraHandle SunxiV4l2cameraHandle;
 typedef struct _SUNXIV4l2Handle SUNXIV4l2Handle;
 typedef gint (*camera_config)(SUNXIV4l2Handle *handle, guint v4l2fmt, guint w, guint h, guint fps_n, guint fps_d);
@@ -67,12 +80,25 @@ struct _SunxiV4l2cameraHandle{
     camera_ops ops;
     guint nplanes;
     gint camera_index;
+    gint queued;
+    gboolean device_only;
+    guint buf_flags;
+    GstSunxiPlaneLayout layout;
+    GMutex buf_lock;
+    guint8 buf_state[VIDEO_MAX_FRAME];
+    gboolean restarting;
+    gboolean events;    /* source change or EOS subscribed, poll for them */
+    guint32 buf_caps;   /* V4L2_BUF_CAP_* from REQBUFS */
 #ifdef __USE_ALLWINNER_ISP__
     AWIspApi *ispPort;
+    guint exposure_id;  /* exposure/gain controls the ISP drives, 0 if none */
+    guint gain_id;
+    gboolean exposure_probed;
 #endif
 };
 
 struct _SUNXIV4l2Handle{
+    gint refcount;      /* the element and every allocator wrapping its buffers */
     gchar *device;
     gint  type;
     int   v4l2_fd;
@@ -93,6 +119,11 @@ typedef struct {
     guint flags;
 }SUNXIV4L2FmtMap;
 
+#define SUNXI_V4L2_FMT_BAYER    (1 << 0)
+#define SUNXI_V4L2_FMT_PACKED   (1 << 1)
+
+#define BAYER_CAPS_MAKE(format) "video/x-bayer, format=(string)" format
+
 typedef struct {
     const gchar *name;
     gboolean bg;
@@ -151,6 +182,30 @@ static SUNXIV4L2FmtMap g_sunxiv4l2fmt_maps[] = {
     {GST_VIDEO_CAPS_MAKE("NV61"), V4L2_PIX_FMT_NV61, GST_VIDEO_FORMAT_NV61, 24, 0},
     {GST_VIDEO_CAPS_MAKE("YVYU"), V4L2_PIX_FMT_YVYU, GST_VIDEO_FORMAT_YVYU, 16, 0},
     {GST_VIDEO_CAPS_MAKE("UYVY"), V4L2_PIX_FMT_UYVY, GST_VIDEO_FORMAT_UYVY, 16, 0},
+    /* raw sensors without the ISP, laid out as one gray plane */
+    {BAYER_CAPS_MAKE("bggr"), V4L2_PIX_FMT_SBGGR8, GST_VIDEO_FORMAT_GRAY8, 8, SUNXI_V4L2_FMT_BAYER},
+    {BAYER_CAPS_MAKE("gbrg"), V4L2_PIX_FMT_SGBRG8, GST_VIDEO_FORMAT_GRAY8, 8, SUNXI_V4L2_FMT_BAYER},
+    {BAYER_CAPS_MAKE("grbg"), V4L2_PIX_FMT_SGRBG8, GST_VIDEO_FORMAT_GRAY8, 8, SUNXI_V4L2_FMT_BAYER},
+    {BAYER_CAPS_MAKE("rggb"), V4L2_PIX_FMT_SRGGB8, GST_VIDEO_FORMAT_GRAY8, 8, SUNXI_V4L2_FMT_BAYER},
+    {BAYER_CAPS_MAKE("bggr10le"), V4L2_PIX_FMT_SBGGR10, GST_VIDEO_FORMAT_GRAY16_LE, 10, SUNXI_V4L2_FMT_BAYER},
+    {BAYER_CAPS_MAKE("gbrg10le"), V4L2_PIX_FMT_SGBRG10, GST_VIDEO_FORMAT_GRAY16_LE, 10, SUNXI_V4L2_FMT_BAYER},
+    {BAYER_CAPS_MAKE("grbg10le"), V4L2_PIX_FMT_SGRBG10, GST_VIDEO_FORMAT_GRAY16_LE, 10, SUNXI_V4L2_FMT_BAYER},
+    {BAYER_CAPS_MAKE("rggb10le"), V4L2_PIX_FMT_SRGGB10, GST_VIDEO_FORMAT_GRAY16_LE, 10, SUNXI_V4L2_FMT_BAYER},
+    {BAYER_CAPS_MAKE("bggr12le"), V4L2_PIX_FMT_SBGGR12, GST_VIDEO_FORMAT_GRAY16_LE, 12, SUNXI_V4L2_FMT_BAYER},
+    {BAYER_CAPS_MAKE("gbrg12le"), V4L2_PIX_FMT_SGBRG12, GST_VIDEO_FORMAT_GRAY16_LE, 12, SUNXI_V4L2_FMT_BAYER},
+    {BAYER_CAPS_MAKE("grbg12le"), V4L2_PIX_FMT_SGRBG12, GST_VIDEO_FORMAT_GRAY16_LE, 12, SUNXI_V4L2_FMT_BAYER},
+    {BAYER_CAPS_MAKE("rggb12le"), V4L2_PIX_FMT_SRGGB12, GST_VIDEO_FORMAT_GRAY16_LE, 12, SUNXI_V4L2_FMT_BAYER},
+    /* packed variants are unpacked to the 16 bit formats above */
+    {BAYER_CAPS_MAKE("bggr10le"), V4L2_PIX_FMT_SBGGR10P, GST_VIDEO_FORMAT_GRAY16_LE, 10, SUNXI_V4L2_FMT_BAYER | SUNXI_V4L2_FMT_PACKED},
+    {BAYER_CAPS_MAKE("gbrg10le"), V4L2_PIX_FMT_SGBRG10P, GST_VIDEO_FORMAT_GRAY16_LE, 10, SUNXI_V4L2_FMT_BAYER | SUNXI_V4L2_FMT_PACKED},
+    {BAYER_CAPS_MAKE("grbg10le"), V4L2_PIX_FMT_SGRBG10P, GST_VIDEO_FORMAT_GRAY16_LE, 10, SUNXI_V4L2_FMT_BAYER | SUNXI_V4L2_FMT_PACKED},
+    {BAYER_CAPS_MAKE("rggb10le"), V4L2_PIX_FMT_SRGGB10P, GST_VIDEO_FORMAT_GRAY16_LE, 10, SUNXI_V4L2_FMT_BAYER | SUNXI_V4L2_FMT_PACKED},
+#ifdef V4L2_PIX_FMT_SBGGR12P
+    {BAYER_CAPS_MAKE("bggr12le"), V4L2_PIX_FMT_SBGGR12P, GST_VIDEO_FORMAT_GRAY16_LE, 12, SUNXI_V4L2_FMT_BAYER | SUNXI_V4L2_FMT_PACKED},
+    {BAYER_CAPS_MAKE("gbrg12le"), V4L2_PIX_FMT_SGBRG12P, GST_VIDEO_FORMAT_GRAY16_LE, 12, SUNXI_V4L2_FMT_BAYER | SUNXI_V4L2_FMT_PACKED},
+    {BAYER_CAPS_MAKE("grbg12le"), V4L2_PIX_FMT_SGRBG12P, GST_VIDEO_FORMAT_GRAY16_LE, 12, SUNXI_V4L2_FMT_BAYER | SUNXI_V4L2_FMT_PACKED},
+    {BAYER_CAPS_MAKE("rggb12le"), V4L2_PIX_FMT_SRGGB12P, GST_VIDEO_FORMAT_GRAY16_LE, 12, SUNXI_V4L2_FMT_BAYER | SUNXI_V4L2_FMT_PACKED},
+#endif
 };
 
 static SUNXIV4L2FmtMap *sunxi_v4l2_get_fmt_map(guint *map_size)
@@ -229,24 +284,52 @@ gst_sunxi_v4l2_camera_config(SUNXIV4l2Handle *handle, guint fmt, guint w, guint
     return 0;
 }
 
-static gint
-gst_sunxi_v4l2_camera_set_fmt(SUNXIV4l2Handle *handle, guint v4l2fmt, GstVideoInfo *info)
+static void
+gst_sunxi_v4l2_camera_get_layout(SUNXIV4l2Handle *handle, const struct v4l2_format *fmt, GstSunxiPlaneLayout *layout)
+{
+    guint i;
+
+    memset(layout, 0, sizeof(*layout));
+
+    if (handle->type == V4L2_CAP_VIDEO_CAPTURE_MPLANE) {
+        layout->n_planes = MIN(fmt->fmt.pix_mp.num_planes, VIDEO_MAX_PLANES);
+        for (i = 0; i < layout->n_planes; i++) {
+            layout->bytesperline[i] = fmt->fmt.pix_mp.plane_fmt[i].bytesperline;
+            layout->sizeimage[i] = fmt->fmt.pix_mp.plane_fmt[i].sizeimage;
+        }
+    } else {
+        layout->n_planes = 1;
+        layout->bytesperline[0] = fmt->fmt.pix.bytesperline;
+        layout->sizeimage[0] = fmt->fmt.pix.sizeimage;
+    }
+}
+
+static void
+gst_sunxi_v4l2_camera_fill_fmt(SUNXIV4l2Handle *handle, guint v4l2fmt, GstVideoInfo *info, struct v4l2_format *fmt)
 {
-    struct v4l2_format fmt = {0};
+    memset(fmt, 0, sizeof(*fmt));
 
     if (handle->type == V4L2_CAP_VIDEO_CAPTURE_MPLANE) {
-        fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
-        fmt.fmt.pix_mp.width = info->width;
-        fmt.fmt.pix_mp.height = info->height;
-        fmt.fmt.pix_mp.pixelformat = v4l2fmt;
-        fmt.fmt.pix_mp.field = V4L2_FIELD_NONE;
+        fmt->type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+        fmt->fmt.pix_mp.width = info->width;
+        fmt->fmt.pix_mp.height = info->height;
+        fmt->fmt.pix_mp.pixelformat = v4l2fmt;
+        fmt->fmt.pix_mp.field = V4L2_FIELD_NONE;
     } else {
-        fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        fmt.fmt.pix.width = info->width;
-        fmt.fmt.pix.height = info->height;
-        fmt.fmt.pix.pixelformat = v4l2fmt;
-        fmt.fmt.pix.field = V4L2_FIELD_NONE;
+        fmt->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        fmt->fmt.pix.width = info->width;
+        fmt->fmt.pix.height = info->height;
+        fmt->fmt.pix.pixelformat = v4l2fmt;
+        fmt->fmt.pix.field = V4L2_FIELD_NONE;
     }
+}
+
+static gint
+gst_sunxi_v4l2_camera_set_fmt(SUNXIV4l2Handle *handle, guint v4l2fmt, GstVideoInfo *info)
+{
+    struct v4l2_format fmt;
+
+    gst_sunxi_v4l2_camera_fill_fmt(handle, v4l2fmt, info, &fmt);
 
     if (ioctl(handle->v4l2_fd, VIDIOC_S_FMT, &fmt) < 0) {
         GST_DEBUG("[%c%c%c%c]", v4l2fmt & 0xff, (v4l2fmt >> 8) & 0xff, 
@@ -272,6 +355,8 @@ gst_sunxi_v4l2_camera_set_fmt(SUNXIV4l2Handle *handle, guint v4l2fmt, GstVideoIn
         handle->camera.win_h = fmt.fmt.pix.height;
     }
 
+    gst_sunxi_v4l2_camera_get_layout(handle, &fmt, &handle->camera.layout);
+
     GST_DEBUG("Format set to %c%c%c%c OK planes:%d", v4l2fmt & 0xff, (v4l2fmt >> 8) & 0xff, 
                     (v4l2fmt >> 16) & 0xff, (v4l2fmt >> 24) & 0xff, handle->camera.nplanes);
 
@@ -329,19 +414,29 @@ static gint
 gst_sunxi_v4l2_camera_streamoff(SUNXIV4l2Handle *handle)
 {
     enum v4l2_buf_type type;
+    gint i;
 
     handle->streamon = FALSE;
 
     if (handle->type == V4L2_CAP_VIDEO_CAPTURE_MPLANE)
         type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
     else
-        type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+        type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 
     if (ioctl(handle->v4l2_fd, VIDIOC_STREAMOFF, &type) < 0) {
         GST_ERROR("VIDIOC_STREAMOFF FAILED.");
         return -1;
     }
 
+    /* STREAMOFF hands every buffer back to userspace */
+    g_atomic_int_set(&handle->camera.queued, 0);
+
+    g_mutex_lock(&handle->camera.buf_lock);
+    for (i = 0; i < VIDEO_MAX_FRAME; i++)
+        if (handle->camera.buf_state[i] == SUNXI_V4L2_BUF_QUEUED)
+            handle->camera.buf_state[i] = SUNXI_V4L2_BUF_IDLE;
+    g_mutex_unlock(&handle->camera.buf_lock);
+
     return 0;
 }
 
@@ -447,9 +542,11 @@ gpointer gst_sunxiv4l2_open_device(gchar *device, int type)
     }
 
     memset(handle, 0, sizeof(SUNXIV4l2Handle));
+    g_mutex_init(&handle->camera.buf_lock);
 
     GST_DEBUG("driver:%s,card:%s,version:0x%x", cap.driver, cap.card, cap.version);
 
+    handle->refcount = 1;
     handle->v4l2_fd = fd;
     handle->device = device;
     handle->streamon = FALSE;
@@ -490,11 +587,26 @@ gpointer gst_sunxiv4l2_open_device(gchar *device, int type)
     return (gpointer)handle;
 }
 
+/* frames downstream keep the device until the last of them is freed */
+gpointer
+gst_sunxiv4l2_ref_device(gpointer v4l2handle)
+{
+    SUNXIV4l2Handle *handle = v4l2handle;
+
+    g_atomic_int_inc(&handle->refcount);
+
+    return handle;
+}
+
+/* drop a reference, the last one closes the device */
 gint
 gst_sunxiv4l2_close_device(gpointer v4l2handle)
 {
     SUNXIV4l2Handle *handle = v4l2handle;
 
+    if (handle && !g_atomic_int_dec_and_test(&handle->refcount))
+        return 0;
+
     if (handle) {
 #ifdef __USE_ALLWINNER_ISP__
         if (strcmp(handle->camera.card, "sunxi-vin") == 0) {
@@ -513,6 +625,7 @@ gst_sunxiv4l2_close_device(gpointer v4l2handle)
             close(handle->v4l2_fd);
             handle->v4l2_fd = 0;
         }
+        g_mutex_clear(&handle->camera.buf_lock);
         g_slice_free1(sizeof(SUNXIV4l2Handle), handle);
     }
 
@@ -730,6 +843,9 @@ gst_sunxi_v4l2_set_buffer_count(gpointer v4l2handle, guint count, guint memory_m
     }
 
     handle->camera.buffer_count = buf_req.count;
+#ifdef V4L2_BUF_CAP_SUPPORTS_MMAP
+    handle->camera.buf_caps = buf_req.capabilities;
+#endif
 
     return 0;
     
@@ -804,29 +920,49 @@ gst_sunxi_v4l2_memory_map_full(gpointer v4l2handle, struct v4l2_buffer *v4l2_buf
 
     g_return_val_if_fail(blk != NULL, GST_FLOW_ERROR);
 
+    for (i = 0; i < 3; i++)
+        blk->dmafd[i] = -1;
+
+    /* device-only consumers never write, and the CPU reads go through
+     * an explicit dma-buf sync instead of the per QBUF/DQBUF one */
+    if (handle->camera.device_only)
+        flags = GST_MAP_READ;
+
+    blk->fd = handle->v4l2_fd;
+    blk->prot = flags;
+
     if (handle->type == V4L2_CAP_VIDEO_CAPTURE_MPLANE) {
-        for (i = 0; i < handle->camera.nplanes; i++) {
+        blk->nplanes = MIN(handle->camera.nplanes, 3);
+        for (i = 0; i < blk->nplanes; i++) {
             blk->len[i] = v4l2_buf->m.planes[i].length;
-            blk->start[i] = mmap(NULL,
-                                v4l2_buf->m.planes[i].length,
-                                flags, MAP_SHARED,
-                                handle->v4l2_fd, v4l2_buf->m.planes[i].m.mem_offset);
-
-            if (blk->start[i] == MAP_FAILED) {
-                GST_ERROR("map FAILED.");
-                g_slice_free1(sizeof(SunxiV4l2camera_mem_block), blk);
-                return GST_FLOW_ERROR;
-            }
+            blk->offset[i] = v4l2_buf->m.planes[i].m.mem_offset;
         }
         free(v4l2_buf->m.planes);
         v4l2_buf->m.planes = NULL;
     } else {
+        blk->nplanes = 1;
         blk->len[0] = v4l2_buf->length;
-        blk->start[0] = mmap(NULL, v4l2_buf->length, flags, MAP_SHARED, handle->v4l2_fd, v4l2_buf->m.offset);
-        if (blk->start[0] == MAP_FAILED) {
-            GST_ERROR("map FAILED.");
-            g_slice_free1(sizeof(SunxiV4l2camera_mem_block), blk);
-            return GST_FLOW_ERROR;
+        blk->offset[0] = v4l2_buf->m.offset;
+    }
+
+    if (handle->camera.device_only) {
+        struct v4l2_exportbuffer expbuf;
+        gint nplanes = handle->type == V4L2_CAP_VIDEO_CAPTURE_MPLANE ? handle->camera.nplanes : 1;
+
+        for (i = 0; i < nplanes; i++) {
+            memset(&expbuf, 0, sizeof(expbuf));
+            expbuf.type = handle->camera.type;
+            expbuf.index = v4l2_buf->index;
+            expbuf.plane = i;
+            expbuf.flags = O_CLOEXEC | O_RDONLY;
+
+            if (ioctl(handle->v4l2_fd, VIDIOC_EXPBUF, &expbuf) < 0) {
+                GST_WARNING("VIDIOC_EXPBUF[%d:%d] failed errno(%d), CPU reads are not synced",
+                    v4l2_buf->index, i, errno);
+                continue;
+            }
+
+            blk->dmafd[i] = expbuf.fd;
         }
     }
 
@@ -848,6 +984,10 @@ gst_sunxiv_v4l2_fmt_gst2v4l2(GstVideoFormat gstfmt)
     SUNXIV4L2FmtMap *fmt_map = sunxi_v4l2_get_fmt_map(&map_size);
 
     for (i = 0; i < map_size; i++) {
+        /* bayer entries borrow the gray formats */
+        if (fmt_map[i].flags & SUNXI_V4L2_FMT_BAYER)
+            continue;
+
         if (gstfmt == fmt_map[i].gstfmt) {
             v4l2_fmt = fmt_map[i].v4l2fmt;
             break;
@@ -914,7 +1054,7 @@ gint
 gst_sunxi_v4l2_streamoff(gpointer v4l2handle)
 {
     SUNXIV4l2Handle *handle = v4l2handle;
-    if (handle->camera.streamon)
+    if (handle->streamon)
         return handle->camera.ops.streamoff(handle);
     
     return 0;
@@ -1409,6 +1549,12 @@ gint gst_sunxi_video_info_from_caps(GstVideoInfo *info, GstCaps *caps)
         fmt = gst_sunxi_format_from_string(s);
         if (fmt == GST_VIDEO_FORMAT_UNKNOWN)
             goto unknown_format;
+    } else if (gst_structure_has_name(structure, "video/x-bayer")) {
+        if (!(s = gst_structure_get_string(structure, "format")))
+            goto no_format;
+
+        /* no video format for bayer, describe it as one gray plane */
+        fmt = strlen(s) > 4 ? GST_VIDEO_FORMAT_GRAY16_LE : GST_VIDEO_FORMAT_GRAY8;
     }
 
     if (!gst_structure_get_int(structure, "width", &width)) {
@@ -1551,7 +1697,7 @@ gboolean gst_sunxiv4l2_is_open(gpointer v4l2handle)
 {
     SUNXIV4l2Handle *handle = v4l2handle;
 
-    handle->v4l2_fd ? TRUE : FALSE;
+    return handle && handle->v4l2_fd ? TRUE : FALSE;
 }
 
 guint gst_sunxiv4l2_fps_n(gpointer v4l2handle)
@@ -1582,6 +1728,7 @@ GstFlowReturn gst_sunxiv4l2_flush_all_buffer(gpointer v4l2handle)
         buf.type = handle->camera.type;
         buf.memory = handle->camera.memory_mode;
         buf.index = i;
+        buf.flags = handle->camera.buf_flags;
 
         if (handle->type == V4L2_CAP_VIDEO_CAPTURE_MPLANE) {
             buf.length = handle->camera.nplanes;
@@ -1597,6 +1744,12 @@ GstFlowReturn gst_sunxiv4l2_flush_all_buffer(gpointer v4l2handle)
             ret = GST_FLOW_ERROR;
             break;
         }
+
+        g_atomic_int_inc(&handle->camera.queued);
+
+        g_mutex_lock(&handle->camera.buf_lock);
+        handle->camera.buf_state[i] = SUNXI_V4L2_BUF_QUEUED;
+        g_mutex_unlock(&handle->camera.buf_lock);
     }
 
     return ret;
@@ -1622,61 +1775,865 @@ gpointer
 gst_sunxiv4l2_camera_pick_buffer(gpointer data, gint idx, gpointer v4l2handle)
 {
     SunxiV4l2camera_mem_block *blk = data;
-    SUNXIV4l2Handle *handle = v4l2handle;
-    int ret;
-    struct timeval tv;
-    fd_set fds;
+    gpointer start;
 
     g_return_val_if_fail(blk->initialized == TRUE, NULL);
-    g_return_val_if_fail(handle != NULL, NULL);
+    g_return_val_if_fail(v4l2handle != NULL, NULL);
+    g_return_val_if_fail(idx >= 0 && idx < blk->nplanes, NULL);
 
-    if (handle->streamon == TRUE) {
-        if (blk->used == FALSE) {
-            blk->v4l2_buf.type = handle->camera.type;
-            blk->v4l2_buf.index = idx;
-            if (handle->type == V4L2_CAP_VIDEO_CAPTURE_MPLANE) {
-                blk->v4l2_buf.length = handle->camera.nplanes;
-                blk->v4l2_buf.m.planes = (struct v4l2_plane *)calloc(blk->v4l2_buf.length, sizeof(struct v4l2_plane));
-            }
-            blk->used = TRUE;
+    start = g_atomic_pointer_get(&blk->start[idx]);
+
+    if (G_LIKELY(start))
+        return start;
+
+    /* a plane nobody reads on the CPU is never mapped */
+    start = mmap(NULL, blk->len[idx], blk->prot, MAP_SHARED, blk->fd, blk->offset[idx]);
+
+    if (start == MAP_FAILED) {
+        GST_ERROR("map plane %d FAILED errno:%d.", idx, errno);
+        return NULL;
+    }
+
+    GST_DEBUG("mapped plane %d, %" G_GSIZE_FORMAT " bytes at %p", idx, blk->len[idx], start);
+
+    if (!g_atomic_pointer_compare_and_exchange(&blk->start[idx], NULL, start)) {
+        /* raced with another thread mapping the same plane */
+        munmap(start, blk->len[idx]);
+        start = g_atomic_pointer_get(&blk->start[idx]);
+    }
+
+    return start;
+}
+
+gint
+gst_sunxiv4l2_camera_block_planes(gpointer data)
+{
+    SunxiV4l2camera_mem_block *blk = data;
+
+    g_return_val_if_fail(blk->initialized == TRUE, 0);
+
+    return blk->nplanes;
+}
+
+static gboolean
+gst_sunxiv4l2_camera_sync(SunxiV4l2camera_mem_block *blk, gint idx, guint64 flags)
+{
+#ifdef DMA_BUF_IOCTL_SYNC
+    struct dma_buf_sync sync = {0};
+
+    if (blk->dmafd[idx] < 0)
+        return TRUE;
+
+    sync.flags = flags;
+
+    if (ioctl(blk->dmafd[idx], DMA_BUF_IOCTL_SYNC, &sync) < 0) {
+        GST_WARNING("DMA_BUF_IOCTL_SYNC(0x%" G_GINT64_MODIFIER "x) failed errno(%d)", flags, errno);
+        return FALSE;
+    }
+#endif
+    return TRUE;
+}
+
+gboolean
+gst_sunxiv4l2_camera_begin_cpu_access(gpointer data, gint idx, gpointer v4l2handle, GstMapFlags flags)
+{
+    SunxiV4l2camera_mem_block *blk = data;
+    SUNXIV4l2Handle *handle = v4l2handle;
+
+    if (!handle->camera.device_only)
+        return TRUE;
+
+    if (flags & GST_MAP_WRITE) {
+        GST_ERROR("buffers are mapped read-only in device-only mode");
+        return FALSE;
+    }
+
+    return gst_sunxiv4l2_camera_sync(blk, idx, DMA_BUF_SYNC_START | DMA_BUF_SYNC_READ);
+}
+
+void
+gst_sunxiv4l2_camera_end_cpu_access(gpointer data, gint idx, gpointer v4l2handle, GstMapFlags flags)
+{
+    SunxiV4l2camera_mem_block *blk = data;
+    SUNXIV4l2Handle *handle = v4l2handle;
+
+    if (handle->camera.device_only)
+        gst_sunxiv4l2_camera_sync(blk, idx, DMA_BUF_SYNC_END | DMA_BUF_SYNC_READ);
+}
+
+/* unmap and free a block once no memory wraps it any more */
+void
+gst_sunxiv4l2_camera_block_free(gpointer data)
+{
+    SunxiV4l2camera_mem_block *blk = data;
+    gint i;
+
+    for (i = 0; i < 3; i++) {
+        if (blk->start[i])
+            munmap(blk->start[i], blk->len[i]);
+        if (blk->dmafd[i] >= 0)
+            close(blk->dmafd[i]);
+    }
+
+    g_slice_free1(sizeof(SunxiV4l2camera_mem_block), blk);
+}
+
+gsize
+gst_sunxiv4l2_camera_block_size(gpointer data, gint idx)
+{
+    SunxiV4l2camera_mem_block *blk = data;
+
+    g_return_val_if_fail(blk->initialized == TRUE, 0);
+
+    return blk->len[idx];
+}
+
+gint
+gst_sunxiv4l2_camera_poll(gpointer v4l2handle, gint timeout_ms)
+{
+    SUNXIV4l2Handle *handle = v4l2handle;
+    struct pollfd pfd;
+    gint ret, ready = 0;
+
+    pfd.fd = handle->v4l2_fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    if (handle->camera.events)
+        pfd.events |= POLLPRI;
+
+    do {
+        ret = poll(&pfd, 1, timeout_ms);
+    } while (ret < 0 && errno == EINTR);
+
+    if (ret < 0) {
+        GST_ERROR("WAIT CAMERA DATA FAILED. errno(%d)", errno);
+        return -1;
+    }
+
+    if (ret == 0)
+        return 0;
+
+    if (pfd.revents & POLLPRI)
+        ready |= GST_SUNXI_V4L2_POLL_EVENT;
+
+    if (pfd.revents & POLLERR) {
+        /* a pending event tells what went wrong */
+        if (ready)
+            return ready;
+
+        /* vb2 reports POLLERR while nothing is queued, i.e. downstream
+         * still holds every buffer. Give it a moment to release one. */
+        if (g_atomic_int_get(&handle->camera.queued) == 0) {
+            g_usleep(MIN(timeout_ms, 2) * 1000);
+            return 0;
         }
 
-        FD_ZERO(&fds);
-        FD_SET(handle->v4l2_fd, &fds);
+        GST_ERROR("camera poll error, revents 0x%x", pfd.revents);
+        return -1;
+    }
+
+    if (pfd.revents & ~POLLPRI)
+        ready |= GST_SUNXI_V4L2_POLL_FRAME;
 
-        ret = select(handle->v4l2_fd + 1, &fds, NULL, NULL, NULL);
+    return ready;
+}
 
-        if (ret < 0) {
-            GST_ERROR("WAIT CAMERA DATA FAILED.");
-            return NULL;
+/*
+ * Ask for the events that end or change the stream. Sensors behind the
+ * VIN usually have neither, poll() then doesn't wait for them.
+ */
+void
+gst_sunxiv4l2_subscribe_events(gpointer v4l2handle)
+{
+    SUNXIV4l2Handle *handle = v4l2handle;
+    struct v4l2_event_subscription sub;
+
+    memset(&sub, 0, sizeof(sub));
+    sub.type = V4L2_EVENT_SOURCE_CHANGE;
+
+    if (ioctl(handle->v4l2_fd, VIDIOC_SUBSCRIBE_EVENT, &sub) == 0)
+        handle->camera.events = TRUE;
+    else
+        GST_DEBUG("no source change events, errno(%d)", errno);
+
+    memset(&sub, 0, sizeof(sub));
+    sub.type = V4L2_EVENT_EOS;
+
+    if (ioctl(handle->v4l2_fd, VIDIOC_SUBSCRIBE_EVENT, &sub) == 0)
+        handle->camera.events = TRUE;
+    else
+        GST_DEBUG("no EOS events, errno(%d)", errno);
+}
+
+/*
+ * Wait for an event alone, for when the stream is off. Without POLLIN vb2
+ * doesn't report POLLERR for a queue that isn't streaming, so this sleeps
+ * until the source says something. 1 for an event, 0 on timeout, -1 on an
+ * error or without events subscribed.
+ */
+gint
+gst_sunxiv4l2_camera_wait_event(gpointer v4l2handle, gint timeout_ms)
+{
+    SUNXIV4l2Handle *handle = v4l2handle;
+    struct pollfd pfd;
+    gint ret;
+
+    if (!handle->camera.events)
+        return -1;
+
+    pfd.fd = handle->v4l2_fd;
+    pfd.events = POLLPRI;
+    pfd.revents = 0;
+
+    do {
+        ret = poll(&pfd, 1, timeout_ms);
+    } while (ret < 0 && errno == EINTR);
+
+    if (ret < 0) {
+        GST_ERROR("WAIT CAMERA EVENT FAILED. errno(%d)", errno);
+        return -1;
+    }
+
+    if (ret == 0)
+        return 0;
+
+    if (pfd.revents & POLLPRI)
+        return 1;
+
+    GST_ERROR("camera event poll error, revents 0x%x", pfd.revents);
+    return -1;
+}
+
+/* the pending event after poll() reported one, its type or -1 */
+gint
+gst_sunxiv4l2_camera_dequeue_event(gpointer v4l2handle, guint32 *changes)
+{
+    SUNXIV4l2Handle *handle = v4l2handle;
+    struct v4l2_event event;
+
+    memset(&event, 0, sizeof(event));
+
+    if (ioctl(handle->v4l2_fd, VIDIOC_DQEVENT, &event) < 0) {
+        /* stop polling for POLLPRI, it would never clear */
+        GST_ERROR("DQEVENT FAILED errno(%d), ignore events from now on", errno);
+        handle->camera.events = FALSE;
+        return -1;
+    }
+
+    GST_DEBUG("event %u sequence %u, %u more pending", event.type, event.sequence, event.pending);
+
+    if (changes)
+        *changes = event.type == V4L2_EVENT_SOURCE_CHANGE ? event.u.src_change.changes : 0;
+
+    return event.type;
+}
+
+/*
+ * What the source sends after it changed. Bridges report the timings
+ * they detected, G_FMT only follows once those are applied.
+ */
+gint
+gst_sunxiv4l2_query_source(gpointer v4l2handle, guint *v4l2fmt, guint *width, guint *height)
+{
+    SUNXIV4l2Handle *handle = v4l2handle;
+    struct v4l2_dv_timings timings;
+    struct v4l2_format fmt;
+
+    memset(&fmt, 0, sizeof(fmt));
+    fmt.type = handle->camera.type;
+
+    if (ioctl(handle->v4l2_fd, VIDIOC_G_FMT, &fmt) < 0) {
+        GST_ERROR("G_FMT FAILED errno(%d)", errno);
+        return -1;
+    }
+
+    if (handle->type == V4L2_CAP_VIDEO_CAPTURE_MPLANE) {
+        *v4l2fmt = fmt.fmt.pix_mp.pixelformat;
+        *width = fmt.fmt.pix_mp.width;
+        *height = fmt.fmt.pix_mp.height;
+    } else {
+        *v4l2fmt = fmt.fmt.pix.pixelformat;
+        *width = fmt.fmt.pix.width;
+        *height = fmt.fmt.pix.height;
+    }
+
+    memset(&timings, 0, sizeof(timings));
+
+    if (ioctl(handle->v4l2_fd, VIDIOC_QUERY_DV_TIMINGS, &timings) == 0) {
+        GST_DEBUG("DV timings %ux%u", timings.bt.width, timings.bt.height);
+        *width = timings.bt.width;
+        *height = timings.bt.height;
+    } else if (errno == ENOLINK || errno == ENOLCK || errno == ERANGE) {
+        GST_WARNING("no usable signal, errno(%d)", errno);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* lock a bridge to the timings it detected, the buffers must be gone */
+gint
+gst_sunxiv4l2_apply_source(gpointer v4l2handle)
+{
+    SUNXIV4l2Handle *handle = v4l2handle;
+    struct v4l2_dv_timings timings;
+
+    memset(&timings, 0, sizeof(timings));
+
+    /* sensors have no timings to apply */
+    if (ioctl(handle->v4l2_fd, VIDIOC_QUERY_DV_TIMINGS, &timings) < 0)
+        return 0;
+
+    if (ioctl(handle->v4l2_fd, VIDIOC_S_DV_TIMINGS, &timings) < 0) {
+        GST_ERROR("S_DV_TIMINGS FAILED errno(%d)", errno);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* REQBUFS(0) may free buffers still mapped, they live on until unmapped */
+gboolean
+gst_sunxiv4l2_orphans_supported(gpointer v4l2handle)
+{
+#ifdef V4L2_BUF_CAP_SUPPORTS_ORPHANED_BUFS
+    SUNXIV4l2Handle *handle = v4l2handle;
+
+    return (handle->camera.buf_caps & V4L2_BUF_CAP_SUPPORTS_ORPHANED_BUFS) != 0;
+#else
+    return FALSE;
+#endif
+}
+
+/*
+ * Stop the stream and give the buffers back to the driver for a new
+ * format. Without orphan support nothing may map them any more.
+ */
+gint
+gst_sunxiv4l2_release_buffers(gpointer v4l2handle)
+{
+    SUNXIV4l2Handle *handle = v4l2handle;
+
+    if (handle->streamon)
+        handle->camera.ops.streamoff(handle);
+
+    g_mutex_lock(&handle->camera.buf_lock);
+    memset(handle->camera.buf_state, SUNXI_V4L2_BUF_IDLE, sizeof(handle->camera.buf_state));
+    g_mutex_unlock(&handle->camera.buf_lock);
+
+    return gst_sunxi_v4l2_set_buffer_count(handle, 0, handle->camera.memory_mode);
+}
+
+gint
+gst_sunxiv4l2_camera_dequeue(gpointer v4l2handle, struct v4l2_buffer *v4l2_buf, struct v4l2_plane *planes)
+{
+    SUNXIV4l2Handle *handle = v4l2handle;
+
+    memset(v4l2_buf, 0, sizeof(struct v4l2_buffer));
+
+    v4l2_buf->type = handle->camera.type;
+    v4l2_buf->memory = handle->camera.memory_mode;
+
+    if (handle->type == V4L2_CAP_VIDEO_CAPTURE_MPLANE) {
+        memset(planes, 0, sizeof(struct v4l2_plane) * VIDEO_MAX_PLANES);
+        v4l2_buf->length = handle->camera.nplanes;
+        v4l2_buf->m.planes = planes;
+    }
+
+    if (gst_sunxiv4l2_camera_dqbuf(handle, v4l2_buf, -1) < 0)
+        return -1;
+
+    g_atomic_int_add(&handle->camera.queued, -1);
+
+    if (v4l2_buf->index < VIDEO_MAX_FRAME) {
+        g_mutex_lock(&handle->camera.buf_lock);
+        handle->camera.buf_state[v4l2_buf->index] = SUNXI_V4L2_BUF_DEQUEUED;
+        g_mutex_unlock(&handle->camera.buf_lock);
+    }
+
+    return v4l2_buf->index;
+}
+
+/* QBUF with buf_lock held */
+static gint
+gst_sunxi_v4l2_camera_queue_locked(SUNXIV4l2Handle *handle, gint idx)
+{
+    struct v4l2_buffer buf;
+    struct v4l2_plane planes[VIDEO_MAX_PLANES];
+
+    memset(&buf, 0, sizeof(struct v4l2_buffer));
+
+    buf.type = handle->camera.type;
+    buf.memory = handle->camera.memory_mode;
+    buf.index = idx;
+    buf.flags = handle->camera.buf_flags;
+
+    if (handle->type == V4L2_CAP_VIDEO_CAPTURE_MPLANE) {
+        memset(planes, 0, sizeof(planes));
+        buf.length = handle->camera.nplanes;
+        buf.m.planes = planes;
+    }
+
+    if (gst_sunxiv4l2_camera_qbuf(handle, &buf, idx) < 0) {
+        GST_ERROR("QBUF[%d] FAILED errno(%d)", idx, errno);
+        return -1;
+    }
+
+    g_atomic_int_inc(&handle->camera.queued);
+
+    if (idx >= 0 && idx < VIDEO_MAX_FRAME)
+        handle->camera.buf_state[idx] = SUNXI_V4L2_BUF_QUEUED;
+
+    return 0;
+}
+
+gint
+gst_sunxiv4l2_camera_requeue(gpointer v4l2handle, gint idx)
+{
+    SUNXIV4l2Handle *handle = v4l2handle;
+    gint ret = 0;
+
+    g_mutex_lock(&handle->camera.buf_lock);
+
+    /* a stopped queue takes buffers again only while it restarts */
+    if (handle->streamon || handle->camera.restarting) {
+        ret = gst_sunxi_v4l2_camera_queue_locked(handle, idx);
+    } else if (idx >= 0 && idx < VIDEO_MAX_FRAME) {
+        handle->camera.buf_state[idx] = SUNXI_V4L2_BUF_IDLE;
+    }
+
+    g_mutex_unlock(&handle->camera.buf_lock);
+
+    return ret;
+}
+
+/*
+ * Restart a stream the driver gave up on: stop it (and the ISP), queue
+ * every buffer nobody holds and start again. Buffers downstream still
+ * has are queued when it releases them, restart or not.
+ */
+gint
+gst_sunxiv4l2_camera_restart(gpointer v4l2handle)
+{
+    SUNXIV4l2Handle *handle = v4l2handle;
+    gint i, ret = 0;
+
+    g_mutex_lock(&handle->camera.buf_lock);
+    handle->camera.restarting = TRUE;
+    g_mutex_unlock(&handle->camera.buf_lock);
+
+#ifdef __USE_ALLWINNER_ISP__
+    if (handle->camera.sensor_type == V4L2_SENSOR_TYPE_RAW && handle->camera.ispPort &&
+        handle->camera.ispId >= 0) {
+        GST_DEBUG("STOP ISP");
+        handle->camera.ispPort->ispStop(handle->camera.ispId);
+    }
+#endif
+
+    if (handle->streamon)
+        handle->camera.ops.streamoff(handle);
+
+    g_mutex_lock(&handle->camera.buf_lock);
+    for (i = 0; i < handle->camera.buffer_count && i < VIDEO_MAX_FRAME; i++) {
+        if (handle->camera.buf_state[i] != SUNXI_V4L2_BUF_IDLE)
+            continue;
+
+        if (gst_sunxi_v4l2_camera_queue_locked(handle, i) < 0) {
+            ret = -1;
+            break;
         }
+    }
+    g_mutex_unlock(&handle->camera.buf_lock);
 
-        ret = gst_sunxiv4l2_camera_dqbuf(handle, &blk->v4l2_buf, 0);
+    if (ret == 0 && !gst_sunxi_v4l2_streamon(handle))
+        ret = -1;
 
-        if (ret < 0) {
-            return NULL;
+    g_mutex_lock(&handle->camera.buf_lock);
+    handle->camera.restarting = FALSE;
+    g_mutex_unlock(&handle->camera.buf_lock);
+
+    GST_DEBUG("stream restart %s, %d buffers queued", ret ? "failed" : "done",
+        g_atomic_int_get(&handle->camera.queued));
+
+    return ret;
+}
+
+gint
+gst_sunxiv4l2_camera_recycle(gpointer v4l2handle)
+{
+    struct v4l2_buffer buf;
+    struct v4l2_plane planes[VIDEO_MAX_PLANES];
+    gint idx;
+
+    idx = gst_sunxiv4l2_camera_dequeue(v4l2handle, &buf, planes);
+
+    if (idx < 0)
+        return -1;
+
+    return gst_sunxiv4l2_camera_requeue(v4l2handle, idx);
+}
+
+gint
+gst_sunxiv4l2_camera_queued(gpointer v4l2handle)
+{
+    SUNXIV4l2Handle *handle = v4l2handle;
+
+    return g_atomic_int_get(&handle->camera.queued);
+}
+
+/*
+ * vb2 drops the cache hint flags unless the queue allows them, the buffers
+ * would still be synced on every QBUF/DQBUF and the exported read-only
+ * maps and dma-buf syncs only add cost. Called after REQBUFS.
+ */
+void
+gst_sunxiv4l2_set_device_only(gpointer v4l2handle, gboolean device_only)
+{
+    SUNXIV4l2Handle *handle = v4l2handle;
+
+    handle->camera.device_only = FALSE;
+    handle->camera.buf_flags = 0;
+
+    if (!device_only)
+        return;
+
+#if defined(V4L2_BUF_CAP_SUPPORTS_MMAP_CACHE_HINTS) && \
+    defined(V4L2_BUF_FLAG_NO_CACHE_INVALIDATE) && defined(V4L2_BUF_FLAG_NO_CACHE_CLEAN)
+    if (handle->camera.buf_caps & V4L2_BUF_CAP_SUPPORTS_MMAP_CACHE_HINTS) {
+        handle->camera.device_only = TRUE;
+        handle->camera.buf_flags = V4L2_BUF_FLAG_NO_CACHE_INVALIDATE | V4L2_BUF_FLAG_NO_CACHE_CLEAN;
+        return;
+    }
+#endif
+
+    GST_WARNING("%s takes no cache hints, device-only has nothing to skip and is off",
+        handle->device);
+}
+
+static gboolean
+sunxi_v4l2_has_format(SUNXIV4l2Handle *handle, guint v4l2fmt)
+{
+    struct v4l2_fmtdesc fmtdesc;
+
+    memset(&fmtdesc, 0, sizeof(fmtdesc));
+    fmtdesc.type = handle->camera.type;
+
+    while (ioctl(handle->v4l2_fd, VIDIOC_ENUM_FMT, &fmtdesc) >= 0) {
+        if (fmtdesc.pixelformat == v4l2fmt)
+            return TRUE;
+
+        fmtdesc.index++;
+    }
+
+    return FALSE;
+}
+
+/*
+ * Resolve a video/x-bayer format to what the device captures. 10/12 bit
+ * formats exist both unpacked and MIPI packed, the unpacked one wins since
+ * it goes downstream without conversion.
+ */
+gboolean
+gst_sunxiv4l2_bayer_format(gpointer v4l2handle, const gchar *format, GstSunxiBayerFormat *bayer)
+{
+    static const gchar *orders[] = {"bggr", "gbrg", "grbg", "rggb"};
+    SUNXIV4l2Handle *handle = v4l2handle;
+    SUNXIV4L2FmtMap *fmt_map;
+    guint map_size, i, j;
+
+    g_return_val_if_fail(format != NULL, FALSE);
+    g_return_val_if_fail(bayer != NULL, FALSE);
+
+    fmt_map = sunxi_v4l2_get_fmt_map(&map_size);
+
+    for (i = 0; i < map_size; i++) {
+        if (!(fmt_map[i].flags & SUNXI_V4L2_FMT_BAYER) ||
+            g_strcmp0(strrchr(fmt_map[i].caps_str, ')') + 1, format))
+            continue;
+
+        if (handle && !sunxi_v4l2_has_format(handle, fmt_map[i].v4l2fmt))
+            continue;
+
+        bayer->v4l2fmt = fmt_map[i].v4l2fmt;
+        bayer->depth = fmt_map[i].bits_per_pixel;
+        bayer->packed = (fmt_map[i].flags & SUNXI_V4L2_FMT_PACKED) != 0;
+        bayer->order = GST_SUNXI_BAYER_BGGR;
+
+        for (j = 0; j < G_N_ELEMENTS(orders); j++) {
+            if (!strncmp(format, orders[j], 4))
+                bayer->order = j;
         }
+
+        return TRUE;
     }
 
-    return blk->start[idx];
+    return FALSE;
 }
 
-void gst_sunxiv4l2_camera_ref_buffer(gpointer data, gint idx, gpointer v4l2handle)
+/*
+ * Selection ioctls take the single planar buffer type, also for MPLANE
+ * devices (older kernels reject the _MPLANE one).
+ */
+gboolean
+gst_sunxiv4l2_crop_supported(gpointer v4l2handle)
 {
-    SunxiV4l2camera_mem_block *blk = data;
     SUNXIV4l2Handle *handle = v4l2handle;
+    struct v4l2_selection sel;
 
-    if (handle->streamon == TRUE) {
-        if (blk->used == FALSE) {
-            blk->v4l2_buf.type = handle->camera.type;
-            blk->v4l2_buf.index = idx;
-            if (handle->type == V4L2_CAP_VIDEO_CAPTURE_MPLANE) {
-                blk->v4l2_buf.length = handle->camera.nplanes;
-                blk->v4l2_buf.m.planes = (struct v4l2_plane *)calloc(blk->v4l2_buf.length, sizeof(struct v4l2_plane));
-            }
-            blk->used = TRUE;        
+    if (!handle)
+        return FALSE;
+
+    memset(&sel, 0, sizeof(sel));
+    sel.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    sel.target = V4L2_SEL_TGT_CROP_BOUNDS;
+
+    if (ioctl(handle->v4l2_fd, VIDIOC_G_SELECTION, &sel) < 0) {
+        GST_DEBUG("%s has no crop selection errno:%d.", handle->device, errno);
+        return FALSE;
+    }
+
+    GST_DEBUG("crop bounds %ux%u at (%d, %d)", sel.r.width, sel.r.height, sel.r.left, sel.r.top);
+
+    return TRUE;
+}
+
+/* program the crop window, called after S_FMT which may reset it */
+gint
+gst_sunxiv4l2_set_crop(gpointer v4l2handle, const struct v4l2_rect *rect)
+{
+    SUNXIV4l2Handle *handle = v4l2handle;
+    struct v4l2_selection sel;
+
+    memset(&sel, 0, sizeof(sel));
+    sel.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    sel.target = V4L2_SEL_TGT_CROP;
+    sel.r = *rect;
+
+    if (ioctl(handle->v4l2_fd, VIDIOC_S_SELECTION, &sel) < 0) {
+        GST_ERROR("VIDIOC_S_SELECTION failed errno:%d.", errno);
+        return -1;
+    }
+
+    if (sel.r.left != rect->left || sel.r.top != rect->top ||
+        sel.r.width != rect->width || sel.r.height != rect->height) {
+        GST_ERROR("crop adjusted to %ux%u at (%d, %d).", sel.r.width, sel.r.height, sel.r.left, sel.r.top);
+        return -1;
+    }
+
+    GST_DEBUG("crop %ux%u at (%d, %d)", sel.r.width, sel.r.height, sel.r.left, sel.r.top);
+
+    return 0;
+}
+
+/* 0 on success, -1 if the device lacks the control or rejects the value */
+gint
+gst_sunxiv4l2_set_ctrl(gpointer v4l2handle, guint id, gint value)
+{
+    SUNXIV4l2Handle *handle = v4l2handle;
+    struct v4l2_queryctrl qc_ctrl;
+    struct v4l2_control ctrl;
+
+    memset(&qc_ctrl, 0, sizeof(qc_ctrl));
+    qc_ctrl.id = id;
+
+    if (ioctl(handle->v4l2_fd, VIDIOC_QUERYCTRL, &qc_ctrl) < 0 ||
+        (qc_ctrl.flags & V4L2_CTRL_FLAG_DISABLED)) {
+        GST_DEBUG("%s has no control 0x%x.", handle->device, id);
+        return -1;
+    }
+
+    memset(&ctrl, 0, sizeof(ctrl));
+    ctrl.id = id;
+    ctrl.value = value;
+
+    if (ioctl(handle->v4l2_fd, VIDIOC_S_CTRL, &ctrl) < 0) {
+        GST_WARNING("set control %s to %d failed errno:%d.", qc_ctrl.name, value, errno);
+        return -1;
+    }
+
+    GST_DEBUG("control %s set to %d", qc_ctrl.name, value);
+
+    return 0;
+}
+
+#ifdef __USE_ALLWINNER_ISP__
+static guint
+gst_sunxi_v4l2_camera_find_ctrl(SUNXIV4l2Handle *handle, const guint *ids, guint n_ids)
+{
+    struct v4l2_queryctrl qc_ctrl;
+    guint i;
+
+    for (i = 0; i < n_ids; i++) {
+        memset(&qc_ctrl, 0, sizeof(qc_ctrl));
+        qc_ctrl.id = ids[i];
+
+        if (ioctl(handle->v4l2_fd, VIDIOC_QUERYCTRL, &qc_ctrl) == 0 &&
+            !(qc_ctrl.flags & V4L2_CTRL_FLAG_DISABLED))
+            return ids[i];
+    }
+
+    return 0;
+}
+#endif
+
+/*
+ * Exposure and gain the ISP set for the sensor, read right after the
+ * dequeue so they belong to the frame at hand or the one before it.
+ * Without the ISP both are -1.
+ */
+gboolean
+gst_sunxiv4l2_get_exposure(gpointer v4l2handle, gint *exposure, gint *gain)
+{
+    SUNXIV4l2Handle *handle = v4l2handle;
+
+    *exposure = -1;
+    *gain = -1;
+
+#ifdef __USE_ALLWINNER_ISP__
+    struct v4l2_control ctrl;
+
+    if (!handle->camera.exposure_probed) {
+        static const guint exposure_ids[] = { V4L2_CID_EXPOSURE_ABSOLUTE, V4L2_CID_EXPOSURE };
+        static const guint gain_ids[] = { V4L2_CID_GAIN, V4L2_CID_ANALOGUE_GAIN };
+
+        handle->camera.exposure_id = gst_sunxi_v4l2_camera_find_ctrl(handle, exposure_ids, ARRAY_SIZE(exposure_ids));
+        handle->camera.gain_id = gst_sunxi_v4l2_camera_find_ctrl(handle, gain_ids, ARRAY_SIZE(gain_ids));
+        handle->camera.exposure_probed = TRUE;
+
+        GST_DEBUG("exposure control 0x%x, gain control 0x%x", handle->camera.exposure_id, handle->camera.gain_id);
+    }
+
+    if (handle->camera.exposure_id) {
+        ctrl.id = handle->camera.exposure_id;
+        if (ioctl(handle->v4l2_fd, VIDIOC_G_CTRL, &ctrl) == 0)
+            *exposure = ctrl.value;
+    }
+
+    if (handle->camera.gain_id) {
+        ctrl.id = handle->camera.gain_id;
+        if (ioctl(handle->v4l2_fd, VIDIOC_G_CTRL, &ctrl) == 0)
+            *gain = ctrl.value;
+    }
+
+    return *exposure >= 0 || *gain >= 0;
+#else
+    (void)handle;
+
+    return FALSE;
+#endif
+}
+
+/* layout the driver would give v4l2fmt at the size of info, nothing is applied */
+gint
+gst_sunxiv4l2_try_format(gpointer v4l2handle, guint v4l2fmt, GstVideoInfo *info, GstSunxiPlaneLayout *layout)
+{
+    SUNXIV4l2Handle *handle = v4l2handle;
+    struct v4l2_format fmt;
+
+    if (!handle)
+        return -1;
+
+    gst_sunxi_v4l2_camera_fill_fmt(handle, v4l2fmt, info, &fmt);
+
+    if (ioctl(handle->v4l2_fd, VIDIOC_TRY_FMT, &fmt) < 0) {
+        GST_DEBUG("VIDIOC_TRY_FMT failed errno:%d.", errno);
+        return -1;
+    }
+
+    gst_sunxi_v4l2_camera_get_layout(handle, &fmt, layout);
+
+    GST_DEBUG("planes %u bytesperline %u sizeimage %u", layout->n_planes,
+        layout->bytesperline[0], layout->sizeimage[0]);
+
+    return 0;
+}
+
+/* layout of the format last set on the device */
+void
+gst_sunxiv4l2_get_layout(gpointer v4l2handle, GstSunxiPlaneLayout *layout)
+{
+    SUNXIV4l2Handle *handle = v4l2handle;
+
+    *layout = handle->camera.layout;
+}
+
+/* read the layout back, a crop set after S_FMT can change it */
+gint
+gst_sunxiv4l2_refresh_layout(gpointer v4l2handle)
+{
+    SUNXIV4l2Handle *handle = v4l2handle;
+    struct v4l2_format fmt;
+
+    memset(&fmt, 0, sizeof(fmt));
+    fmt.type = handle->camera.type;
+
+    if (ioctl(handle->v4l2_fd, VIDIOC_G_FMT, &fmt) < 0) {
+        GST_ERROR("G_FMT FAILED errno(%d)", errno);
+        return -1;
+    }
+
+    gst_sunxi_v4l2_camera_get_layout(handle, &fmt, &handle->camera.layout);
+
+    return 0;
+}
+
+/*
+ * Take the strides and offsets of info from the driver instead of the
+ * computed ones. A single buffer format gets the driver's padding as
+ * a GstVideoAlignment, so it can be negotiated downstream. Formats with
+ * one buffer per plane are described as if the planes were concatenated.
+ */
+gboolean
+gst_sunxi_video_info_apply_layout(GstVideoInfo *info, const GstSunxiPlaneLayout *layout, GstVideoAlignment *align)
+{
+    guint pstride = GST_VIDEO_INFO_COMP_PSTRIDE(info, 0);
+    gsize offset = 0, row;
+    guint i;
+
+    gst_video_alignment_reset(align);
+
+    if (!layout->n_planes || !layout->bytesperline[0] || !pstride)
+        return FALSE;
+
+    if (layout->n_planes > 1) {
+        if (layout->n_planes != GST_VIDEO_INFO_N_PLANES(info))
+            return FALSE;
+
+        for (i = 0; i < layout->n_planes; i++) {
+            info->stride[i] = layout->bytesperline[i];
+            info->offset[i] = offset;
+            offset += layout->sizeimage[i];
         }
 
-        gst_sunxiv4l2_camera_qbuf(handle, &blk->v4l2_buf, idx);
+        info->size = offset;
+
+        return TRUE;
     }
+
+    if (layout->bytesperline[0] < GST_VIDEO_INFO_WIDTH(info) * pstride)
+        return FALSE;
+
+    align->padding_right = layout->bytesperline[0] / pstride - GST_VIDEO_INFO_WIDTH(info);
+
+    if (!gst_video_info_align(info, align))
+        return FALSE;
+
+    if (layout->sizeimage[0] > info->size) {
+        /* the height is padded too, in whole (even) luma rows */
+        row = info->size / GST_VIDEO_INFO_HEIGHT(info);
+        align->padding_bottom = ((layout->sizeimage[0] - info->size) / row) & ~1;
+
+        if (align->padding_bottom && !gst_video_info_align(info, align))
+            return FALSE;
+    }
+
+    if ((guint)info->stride[0] != layout->bytesperline[0]) {
+        GST_WARNING("stride %d instead of the driver's %u", info->stride[0], layout->bytesperline[0]);
+        return FALSE;
+    }
+
+    info->size = MAX(info->size, layout->sizeimage[0]);
+
+    return TRUE;
 }
@@ -4,7 +4,7 @@
 #include <linux/videodev2.h>
 
 #include <gst/gst.h>
-#include <gst/video/video-info.h>
+#include <gst/video/video.h>
 
 enum v4l2_sensor_type {
     V4L2_SENSOR_TYPE_YUV = 0,
@@ -16,10 +16,36 @@ enum v4l2_sensor_type {
 
 #define ARRAY_SIZE(arr) (sizeof(arr)/sizeof((arr)[0]))
 
+typedef enum {
+    GST_SUNXI_BAYER_BGGR,
+    GST_SUNXI_BAYER_GBRG,
+    GST_SUNXI_BAYER_GRBG,
+    GST_SUNXI_BAYER_RGGB,
+} GstSunxiBayerOrder;
+
+typedef struct {
+    guint v4l2fmt;
+    guint depth;        /* significant bits per sample */
+    gboolean packed;    /* MIPI CSI-2 packing, else one sample per byte/word */
+    GstSunxiBayerOrder order;
+} GstSunxiBayerFormat;
+
+/* per-plane layout as reported by VIDIOC_G_FMT/VIDIOC_TRY_FMT */
+typedef struct {
+    guint n_planes;     /* memory planes, 1 unless the format is an M variant */
+    guint bytesperline[VIDEO_MAX_PLANES];
+    guint sizeimage[VIDEO_MAX_PLANES];
+} GstSunxiPlaneLayout;
+
+/* what gst_sunxiv4l2_camera_poll() found ready */
+#define GST_SUNXI_V4L2_POLL_FRAME (1 << 0)
+#define GST_SUNXI_V4L2_POLL_EVENT (1 << 1)
+
 GstCaps *gst_sunxiv4l2_get_device_caps(gint type);
 gpointer gst_sunxiv4l2_open_device(gchar *device, int type);
 GstCaps *gst_sunxiv4l2_get_caps(gpointer v4l2handle);
 gint gst_sunxiv4l2_close_device(gpointer handle);
+gpointer gst_sunxiv4l2_ref_device(gpointer v4l2handle);
 gint gst_sunxi_v4l2_set_buffer_count(gpointer v4l2handle, guint count, guint memory_mode);
 gint gst_sunxi_v4l2_allocate_buffer(gpointer v4l2handle, gint idx, struct v4l2_buffer *buf);
 gint gst_sunxi_v4l2_free_buffer(gpointer v4l2handle, gint idx);
@@ -42,6 +68,33 @@ gint gst_sunxiv4l2_camera_qbuf(gpointer v4l2handle, struct v4l2_buffer *v4l2_buf
 gint gst_sunxiv4l2_camera_dqbuf(gpointer v4l2handle, struct v4l2_buffer *v4l2_buf, gint idx);
 
 gpointer gst_sunxiv4l2_camera_pick_buffer(gpointer data, gint idx, gpointer v4l2handle);
-void gst_sunxiv4l2_camera_ref_buffer(gpointer data, gint idx, gpointer v4l2handle);
+gsize gst_sunxiv4l2_camera_block_size(gpointer data, gint idx);
+gint gst_sunxiv4l2_camera_block_planes(gpointer data);
+void gst_sunxiv4l2_camera_block_free(gpointer data);
+gboolean gst_sunxiv4l2_camera_begin_cpu_access(gpointer data, gint idx, gpointer v4l2handle, GstMapFlags flags);
+void gst_sunxiv4l2_camera_end_cpu_access(gpointer data, gint idx, gpointer v4l2handle, GstMapFlags flags);
+gint gst_sunxiv4l2_camera_poll(gpointer v4l2handle, gint timeout_ms);
+gint gst_sunxiv4l2_camera_dequeue(gpointer v4l2handle, struct v4l2_buffer *v4l2_buf, struct v4l2_plane *planes);
+gint gst_sunxiv4l2_camera_requeue(gpointer v4l2handle, gint idx);
+gint gst_sunxiv4l2_camera_recycle(gpointer v4l2handle);
+gint gst_sunxiv4l2_camera_restart(gpointer v4l2handle);
+gint gst_sunxiv4l2_camera_queued(gpointer v4l2handle);
+void gst_sunxiv4l2_subscribe_events(gpointer v4l2handle);
+gint gst_sunxiv4l2_camera_dequeue_event(gpointer v4l2handle, guint32 *changes);
+gint gst_sunxiv4l2_camera_wait_event(gpointer v4l2handle, gint timeout_ms);
+gint gst_sunxiv4l2_query_source(gpointer v4l2handle, guint *v4l2fmt, guint *width, guint *height);
+gint gst_sunxiv4l2_apply_source(gpointer v4l2handle);
+gint gst_sunxiv4l2_release_buffers(gpointer v4l2handle);
+gboolean gst_sunxiv4l2_orphans_supported(gpointer v4l2handle);
+void gst_sunxiv4l2_set_device_only(gpointer v4l2handle, gboolean device_only);
+gboolean gst_sunxiv4l2_bayer_format(gpointer v4l2handle, const gchar *format, GstSunxiBayerFormat *bayer);
+gboolean gst_sunxiv4l2_crop_supported(gpointer v4l2handle);
+gint gst_sunxiv4l2_set_crop(gpointer v4l2handle, const struct v4l2_rect *rect);
+gint gst_sunxiv4l2_set_ctrl(gpointer v4l2handle, guint id, gint value);
+gint gst_sunxiv4l2_try_format(gpointer v4l2handle, guint v4l2fmt, GstVideoInfo *info, GstSunxiPlaneLayout *layout);
+void gst_sunxiv4l2_get_layout(gpointer v4l2handle, GstSunxiPlaneLayout *layout);
+gint gst_sunxiv4l2_refresh_layout(gpointer v4l2handle);
+gboolean gst_sunxiv4l2_get_exposure(gpointer v4l2handle, gint *exposure, gint *gain);
+gboolean gst_sunxi_video_info_apply_layout(GstVideoInfo *info, const GstSunxiPlaneLayout *layout, GstVideoAlignment *align);
 
 #endif
\ No newline at end of file
@@ -5,6 +5,10 @@
 #include <gst/gstmemory.h>
 
 #include "gstsunxiv4l2allocator.h"
+#include "gstsunxiv4l2simd.h"
+
+#define SUNXI_V4L2_COPY_CACHE_MAX 4
+#define SUNXI_V4L2_COPY_ALIGN 64
 
 GST_DEBUG_CATEGORY_STATIC(sunxiv4l2_allocator_debug);
 #define GST_CAT_DEFAULT sunxiv4l2_allocator_debug
@@ -17,6 +21,45 @@ sunxi_v4l2_free_memory(GstAllocator *allocator, GstMemory *memory)
 {
     GstAllocatorSunxiV4l2 *v4l2_allocator = GST_ALLOCATOR_SUNXIV4L2(allocator);
     SUNXIV4l2AllocatorContext *ctx = &v4l2_allocator->ctx;
+
+    if (memory->parent) {
+        /* shared sub-memory, the parent owns the storage */
+        g_slice_free(GstSunxiV4l2Memory, (GstSunxiV4l2Memory *)memory);
+        return;
+    }
+
+    if (GST_MEMORY_FLAG_IS_SET(memory, GST_SUNXI_V4L2_MEMORY_FLAG_FRAME)) {
+        GstSunxiV4l2Memory *vmem = (GstSunxiV4l2Memory *)memory;
+
+        if (!g_atomic_int_get(&v4l2_allocator->retired)) {
+            GST_LOG("requeue buffer %d", vmem->index);
+            gst_sunxiv4l2_camera_requeue(ctx->v4l2_handle, vmem->index);
+        }
+        g_slice_free(GstSunxiV4l2Memory, vmem);
+
+        GST_OBJECT_LOCK(v4l2_allocator);
+        if (--v4l2_allocator->outstanding == 0)
+            g_cond_broadcast(&v4l2_allocator->idle);
+        GST_OBJECT_UNLOCK(v4l2_allocator);
+        return;
+    }
+
+    if (GST_MEMORY_FLAG_IS_SET(memory, GST_SUNXI_V4L2_MEMORY_FLAG_COPY)) {
+        GstSunxiV4l2Memory *vmem = (GstSunxiV4l2Memory *)memory;
+
+        GST_OBJECT_LOCK(v4l2_allocator);
+        if (memory->maxsize == v4l2_allocator->copy_size &&
+            g_list_length(v4l2_allocator->copy_cache) < SUNXI_V4L2_COPY_CACHE_MAX) {
+            v4l2_allocator->copy_cache = g_list_prepend(v4l2_allocator->copy_cache, vmem->data);
+            vmem->data = NULL;
+        }
+        GST_OBJECT_UNLOCK(v4l2_allocator);
+
+        free(vmem->data);
+        g_slice_free(GstSunxiV4l2Memory, vmem);
+        return;
+    }
+
     GST_DEBUG("------------");
 }
 
@@ -89,11 +132,20 @@ sunxi_v4l2_alloc_memory(GstAllocator *allocator, gsize size,
 static gpointer
 sunxi_v4l2_mem_map_full(GstMemory *mem, GstMapInfo * info, gsize maxsize)
 {
-    gpointer data;
+    gpointer data = NULL;
     GstAllocatorSunxiV4l2 *v4l2_allocator = GST_ALLOCATOR_SUNXIV4L2(mem->allocator);
     SUNXIV4l2AllocatorContext *ctx = &v4l2_allocator->ctx;
 
-    if (g_list_length(v4l2_allocator->blk_list) > 0) {
+    if (GST_MEMORY_FLAG_IS_SET(mem, GST_SUNXI_V4L2_MEMORY_FLAG_FRAME)) {
+        GstSunxiV4l2Memory *vmem = (GstSunxiV4l2Memory *)mem;
+
+        if (!gst_sunxiv4l2_camera_begin_cpu_access(vmem->blk, vmem->plane, ctx->v4l2_handle, info->flags))
+            return NULL;
+
+        data = gst_sunxiv4l2_camera_pick_buffer(vmem->blk, vmem->plane, ctx->v4l2_handle);
+    } else if (GST_MEMORY_FLAG_IS_SET(mem, GST_SUNXI_V4L2_MEMORY_FLAG_COPY)) {
+        data = ((GstSunxiV4l2Memory *)mem)->data;
+    } else if (g_list_length(v4l2_allocator->blk_list) > 0) {
         GList *list = g_list_first(v4l2_allocator->blk_list);
 
         data = gst_sunxiv4l2_camera_pick_buffer(list->data, 0, ctx->v4l2_handle);
@@ -105,28 +157,121 @@ sunxi_v4l2_mem_map_full(GstMemory *mem, GstMapInfo * info, gsize maxsize)
 static void
 sunxi_v4l2_mem_unmap_full(GstMemory *mem, GstMapInfo * info)
 {
-    GList *list;
     GstAllocatorSunxiV4l2 *v4l2_allocator = GST_ALLOCATOR_SUNXIV4L2(mem->allocator);
     SUNXIV4l2AllocatorContext *ctx = &v4l2_allocator->ctx;
 
-    list = g_list_first(v4l2_allocator->blk_list);
+    /* buffers go back to the driver when the memory is freed */
+    if (GST_MEMORY_FLAG_IS_SET(mem, GST_SUNXI_V4L2_MEMORY_FLAG_FRAME)) {
+        GstSunxiV4l2Memory *vmem = (GstSunxiV4l2Memory *)mem;
+
+        gst_sunxiv4l2_camera_end_cpu_access(vmem->blk, vmem->plane, ctx->v4l2_handle, info->flags);
+    }
+}
+
+static GstMemory *
+sunxi_v4l2_copy_alloc(GstAllocatorSunxiV4l2 *v4l2_allocator, gsize size)
+{
+    GstSunxiV4l2Memory *mem;
+    gpointer data = NULL;
+
+    GST_OBJECT_LOCK(v4l2_allocator);
+    if (size != v4l2_allocator->copy_size) {
+        g_list_free_full(v4l2_allocator->copy_cache, free);
+        v4l2_allocator->copy_cache = NULL;
+        v4l2_allocator->copy_size = size;
+    }
+
+    if (v4l2_allocator->copy_cache) {
+        data = v4l2_allocator->copy_cache->data;
+        v4l2_allocator->copy_cache = g_list_delete_link(v4l2_allocator->copy_cache, v4l2_allocator->copy_cache);
+    }
+    GST_OBJECT_UNLOCK(v4l2_allocator);
+
+    if (!data && posix_memalign(&data, SUNXI_V4L2_COPY_ALIGN, MAX(size, 1)) != 0) {
+        GST_ERROR("allocate %" G_GSIZE_FORMAT " bytes for copy failed.", size);
+        return NULL;
+    }
+
+    mem = g_slice_new0(GstSunxiV4l2Memory);
 
-    gst_sunxiv4l2_camera_ref_buffer(list->data, 0, ctx->v4l2_handle);
+    gst_memory_init(GST_MEMORY_CAST(mem), GST_SUNXI_V4L2_MEMORY_FLAG_COPY,
+        GST_ALLOCATOR_CAST(v4l2_allocator), NULL, size, SUNXI_V4L2_COPY_ALIGN - 1, 0, size);
+
+    mem->index = -1;
+    mem->data = data;
+
+    return GST_MEMORY_CAST(mem);
 }
 
 static GstMemory *
 sunxi_v4l2_mem_copy(GstMemory *mem, gssize offset, gssize size)
 {
-    GstMemory *ret;
+    GstAllocatorSunxiV4l2 *v4l2_allocator = GST_ALLOCATOR_SUNXIV4L2(mem->allocator);
+    GstSunxiV4l2Memory *copy;
+    GstMapInfo info;
 
-    ret = gst_allocator_alloc(NULL, 0, NULL);
+    if (size == -1)
+        size = mem->size > offset ? mem->size - offset : 0;
 
-    g_return_val_if_fail(ret != NULL, NULL);
+    copy = (GstSunxiV4l2Memory *)sunxi_v4l2_copy_alloc(v4l2_allocator, size);
 
-    ret->offset = offset;
-    ret->size = size;
+    g_return_val_if_fail(copy != NULL, NULL);
 
-    return ret;
+    if (!gst_memory_map(mem, &info, GST_MAP_READ)) {
+        GST_ERROR("map memory for copy failed.");
+        gst_memory_unref(GST_MEMORY_CAST(copy));
+        return NULL;
+    }
+
+    gst_sunxiv4l2_stream_copy(copy->data, info.data + offset, size);
+
+    gst_memory_unmap(mem, &info);
+
+    return GST_MEMORY_CAST(copy);
+}
+
+static GstMemory *
+sunxi_v4l2_mem_share(GstMemory *mem, gssize offset, gssize size)
+{
+    GstSunxiV4l2Memory *vmem = (GstSunxiV4l2Memory *)mem;
+    GstSunxiV4l2Memory *sub;
+    GstMemory *parent;
+
+    if ((parent = mem->parent) == NULL)
+        parent = mem;
+
+    if (size == -1)
+        size = mem->size - offset;
+
+    sub = g_slice_new0(GstSunxiV4l2Memory);
+
+    /* the V4L2 buffer stays dequeued until every share is released */
+    gst_memory_init(GST_MEMORY_CAST(sub),
+        GST_MINI_OBJECT_FLAGS(parent) | GST_MINI_OBJECT_FLAG_LOCK_READONLY,
+        mem->allocator, parent, mem->maxsize, mem->align, mem->offset + offset, size);
+
+    sub->index = vmem->index;
+    sub->plane = vmem->plane;
+    sub->blk = vmem->blk;
+    sub->data = vmem->data;
+
+    return GST_MEMORY_CAST(sub);
+}
+
+static gboolean
+sunxi_v4l2_mem_is_span(GstMemory *mem1, GstMemory *mem2, gsize *offset)
+{
+    GstSunxiV4l2Memory *vmem1 = (GstSunxiV4l2Memory *)mem1;
+    GstSunxiV4l2Memory *vmem2 = (GstSunxiV4l2Memory *)mem2;
+
+    /* planes split from one V4L2 plane merge back without a copy */
+    if (!mem1->parent || vmem1->blk != vmem2->blk || vmem1->plane != vmem2->plane)
+        return FALSE;
+
+    if (offset)
+        *offset = mem1->offset - mem1->parent->offset;
+
+    return mem1->offset + mem1->size == mem2->offset;
 }
 
 static void
@@ -140,18 +285,41 @@ gst_allocator_sunxiv4l2_init(GstAllocatorSunxiV4l2 *allocator)
     memset(&allocator->ctx, 0, sizeof(SUNXIV4l2AllocatorContext));
 
     allocator->initialized = FALSE;
+    g_cond_init(&allocator->idle);
 
     alloc->mem_map_full = sunxi_v4l2_mem_map_full;
     alloc->mem_unmap_full = sunxi_v4l2_mem_unmap_full;
     alloc->mem_copy = sunxi_v4l2_mem_copy;
+    alloc->mem_share = sunxi_v4l2_mem_share;
+    alloc->mem_is_span = sunxi_v4l2_mem_is_span;
+
+}
+
+static void
+gst_allocator_sunxiv4l2_finalize(GObject *object)
+{
+    GstAllocatorSunxiV4l2 *allocator = GST_ALLOCATOR_SUNXIV4L2(object);
 
+    /* every memory holds a ref, nothing maps the blocks any more */
+    g_list_free_full(allocator->blk_list, gst_sunxiv4l2_camera_block_free);
+    g_list_free_full(allocator->copy_cache, free);
+    g_list_free(allocator->mem_list);
+    g_cond_clear(&allocator->idle);
+
+    gst_sunxiv4l2_close_device(allocator->ctx.v4l2_handle);
+
+    G_OBJECT_CLASS(gst_allocator_sunxiv4l2_parent_class)->finalize(object);
 }
 
 static void
 gst_allocator_sunxiv4l2_class_init(GstAllocatorSunxiV4l2Class *klass)
 {
+    GObjectClass *gobject_class;
     GstAllocatorClass *allocator_class;
 
+    gobject_class = G_OBJECT_CLASS(klass);
+    gobject_class->finalize = gst_allocator_sunxiv4l2_finalize;
+
     allocator_class = GST_ALLOCATOR_CLASS(klass);
     allocator_class->free = sunxi_v4l2_free_memory;
     allocator_class->alloc = sunxi_v4l2_alloc_memory;
@@ -173,6 +341,7 @@ gst_sunxi_v4l2_allocator_new(SUNXIV4l2AllocatorContext *ctx)
     allocator = gst_object_ref_sink(allocator);
 
     memcpy(&allocator->ctx, ctx, sizeof(*ctx));
+    gst_sunxiv4l2_ref_device(allocator->ctx.v4l2_handle);
 
     return (GstAllocator *)allocator;
 }
@@ -203,4 +372,120 @@ gst_sunxi_v4l2_buffer_register(GstAllocator *allocator)
     sunxi_allocator->initialized = TRUE;
 
     return ret;
-}
\ No newline at end of file
+}
+
+GstMemory *
+gst_sunxi_v4l2_allocator_wrap(GstAllocator *allocator, gint index)
+{
+    GstSunxiV4l2Memory *mem;
+    gpointer blk;
+    gsize size;
+    GstAllocatorSunxiV4l2 *sunxi_allocator = GST_ALLOCATOR_SUNXIV4L2(allocator);
+
+    blk = g_list_nth_data(sunxi_allocator->blk_list, index);
+
+    g_return_val_if_fail(blk != NULL, NULL);
+
+    size = gst_sunxiv4l2_camera_block_size(blk, 0);
+
+    mem = g_slice_new0(GstSunxiV4l2Memory);
+
+    gst_memory_init(GST_MEMORY_CAST(mem),
+        GST_SUNXI_V4L2_MEMORY_FLAG_FRAME,
+        allocator, NULL, size, 0, 0, size);
+
+    mem->index = index;
+    mem->blk = blk;
+
+    GST_OBJECT_LOCK(sunxi_allocator);
+    sunxi_allocator->outstanding++;
+    GST_OBJECT_UNLOCK(sunxi_allocator);
+
+    return GST_MEMORY_CAST(mem);
+}
+
+/*
+ * Memory for one plane of a wrapped frame: a window at offset of the
+ * V4L2 plane. It keeps the frame alive, the buffer is requeued once
+ * every plane is released.
+ */
+GstMemory *
+gst_sunxi_v4l2_allocator_wrap_plane(GstMemory *frame, gint plane, gsize offset, gsize size)
+{
+    GstSunxiV4l2Memory *vframe = (GstSunxiV4l2Memory *)frame;
+    GstSunxiV4l2Memory *mem;
+    gsize maxsize;
+
+    g_return_val_if_fail(GST_MEMORY_FLAG_IS_SET(frame, GST_SUNXI_V4L2_MEMORY_FLAG_FRAME), NULL);
+    g_return_val_if_fail(plane < gst_sunxiv4l2_camera_block_planes(vframe->blk), NULL);
+
+    maxsize = gst_sunxiv4l2_camera_block_size(vframe->blk, plane);
+
+    g_return_val_if_fail(offset + size <= maxsize, NULL);
+
+    mem = g_slice_new0(GstSunxiV4l2Memory);
+
+    gst_memory_init(GST_MEMORY_CAST(mem), GST_SUNXI_V4L2_MEMORY_FLAG_FRAME,
+        frame->allocator, frame, maxsize, 0, offset, size);
+
+    mem->index = vframe->index;
+    mem->plane = plane;
+    mem->blk = vframe->blk;
+
+    return GST_MEMORY_CAST(mem);
+}
+
+gint
+gst_sunxi_v4l2_allocator_n_planes(GstMemory *frame)
+{
+    GstSunxiV4l2Memory *vframe = (GstSunxiV4l2Memory *)frame;
+
+    g_return_val_if_fail(GST_MEMORY_FLAG_IS_SET(frame, GST_SUNXI_V4L2_MEMORY_FLAG_FRAME), 0);
+
+    return gst_sunxiv4l2_camera_block_planes(vframe->blk);
+}
+
+/*
+ * Stop requeueing, the driver buffers are about to be released for a
+ * new format. Wait up to timeout_us (or until *cancel is set) for the
+ * frames downstream still has, then unmap the blocks so the driver can
+ * free them. FALSE if frames are still out, their blocks then go with
+ * the last of them.
+ */
+gboolean
+gst_sunxi_v4l2_allocator_release(GstAllocator *allocator, gint64 timeout_us, gint *cancel)
+{
+    GstAllocatorSunxiV4l2 *sunxi_allocator = GST_ALLOCATOR_SUNXIV4L2(allocator);
+    gint64 deadline = g_get_monotonic_time() + timeout_us;
+    GList *blk_list = NULL;
+    gint outstanding;
+
+    g_atomic_int_set(&sunxi_allocator->retired, TRUE);
+
+    GST_OBJECT_LOCK(sunxi_allocator);
+
+    while (sunxi_allocator->outstanding > 0 && g_get_monotonic_time() < deadline &&
+        !(cancel && g_atomic_int_get(cancel))) {
+        /* short slices, cancel has no cond to signal */
+        g_cond_wait_until(&sunxi_allocator->idle, GST_OBJECT_GET_LOCK(sunxi_allocator),
+            MIN(deadline, g_get_monotonic_time() + 10 * G_TIME_SPAN_MILLISECOND));
+    }
+
+    outstanding = sunxi_allocator->outstanding;
+
+    if (outstanding == 0) {
+        blk_list = sunxi_allocator->blk_list;
+        sunxi_allocator->blk_list = NULL;
+    }
+
+    GST_OBJECT_UNLOCK(sunxi_allocator);
+
+    if (outstanding) {
+        GST_WARNING("%d frames still downstream", outstanding);
+        return FALSE;
+    }
+
+    g_list_free_full(blk_list, gst_sunxiv4l2_camera_block_free);
+
+    return TRUE;
+}
@@ -13,6 +13,11 @@
 
 typedef gint (*SUNXIV4l2AllocatorCb)(gpointer user_data, gint *buffer_count);
 
+/* memory wrapping one dequeued V4L2 buffer, requeued when freed */
+#define GST_SUNXI_V4L2_MEMORY_FLAG_FRAME (GST_MEMORY_FLAG_LAST << 0)
+/* system memory copy of a frame, backing storage is cached by the allocator */
+#define GST_SUNXI_V4L2_MEMORY_FLAG_COPY (GST_MEMORY_FLAG_LAST << 1)
+
 typedef struct _GstAllocatorSunxiV4l2Class GstAllocatorSunxiV4l2Class;
 typedef struct _GstAllocatorSunxiV4l2 GstAllocatorSunxiV4l2;
 
@@ -34,10 +39,23 @@ struct _GstAllocatorSunxiV4l2{
     // gboolean in_used[3];
     // gint mapped;
     gint allocated; 
+    GList *copy_cache;
+    gsize copy_size;
+    gboolean retired;   /* the driver buffers are gone, don't requeue */
+    gint outstanding;   /* frame memories not freed yet */
+    GCond idle;         /* signalled when outstanding drops to 0 */
     // gpointer priv[3];
     // GstMemory *mem[3];
 };
 
+typedef struct {
+    GstMemory mem;
+    gint index;
+    gint plane;     /* V4L2 plane backing the memory */
+    gpointer blk;
+    gpointer data;
+}GstSunxiV4l2Memory;
+
 struct _GstAllocatorSunxiV4l2Class {
     GstAllocatorClass parent_class;
 };
@@ -48,5 +66,9 @@ GType gst_allocator_sunxiv4l2_get_type(void);
 
 GstAllocator *gst_sunxi_v4l2_allocator_new(SUNXIV4l2AllocatorContext *ctx);
 GstFlowReturn gst_sunxi_v4l2_buffer_register(GstAllocator *allocator);
+GstMemory *gst_sunxi_v4l2_allocator_wrap(GstAllocator *allocator, gint index);
+GstMemory *gst_sunxi_v4l2_allocator_wrap_plane(GstMemory *frame, gint plane, gsize offset, gsize size);
+gint gst_sunxi_v4l2_allocator_n_planes(GstMemory *frame);
+gboolean gst_sunxi_v4l2_allocator_release(GstAllocator *allocator, gint64 timeout_us, gint *cancel);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,903 @@
+#include <string.h>
+
+#include <gst/gst.h>
+#include <gst/video/video-info.h>
+
+#include "gstsunxiv4l2convert.h"
+#include "gstsunxiv4l2simd.h"
+
+GST_DEBUG_CATEGORY_STATIC(sunxiv4l2_convert_debug);
+#define GST_CAT_DEFAULT sunxiv4l2_convert_debug
+
+/* frames smaller than this are not worth waking up the workers */
+#define PARALLEL_MIN_PIXELS (1280 * 720)
+
+typedef struct {
+    GMutex lock;
+    GCond cond;
+    gint pending;
+} RowSync;
+
+typedef struct {
+    GstSunxiV4l2RowFunc func;
+    gpointer user_data;
+    guint row_start;
+    guint row_end;
+    RowSync *sync;
+} RowTask;
+
+static GThreadPool *row_pool = NULL;
+
+static void
+row_worker(gpointer data, gpointer pool_data)
+{
+    RowTask *task = data;
+
+    task->func(task->user_data, task->row_start, task->row_end);
+
+    g_mutex_lock(&task->sync->lock);
+    if (--task->sync->pending == 0)
+        g_cond_signal(&task->sync->cond);
+    g_mutex_unlock(&task->sync->lock);
+}
+
+static GThreadPool *
+row_pool_get(void)
+{
+    static gsize initialized = 0;
+
+    if (g_once_init_enter(&initialized)) {
+        GST_DEBUG_CATEGORY_INIT(sunxiv4l2_convert_debug, "sunxiv4l2_convert", 0, "SUNXI V4L2 frame conversion");
+
+        row_pool = g_thread_pool_new(row_worker, NULL, SUNXI_V4L2_MAX_WORKERS - 1, FALSE, NULL);
+        if (!row_pool)
+            GST_WARNING("create worker pool failed, converting on the streaming thread only.");
+
+        g_once_init_leave(&initialized, 1);
+    }
+
+    return row_pool;
+}
+
+guint
+gst_sunxiv4l2_default_threads(void)
+{
+    return CLAMP(g_get_num_processors(), 1, SUNXI_V4L2_MAX_WORKERS);
+}
+
+/*
+ * Split [0, rows) in n_threads slices starting on multiples of align, run
+ * the first slice on the calling thread and the others on the worker pool.
+ */
+void
+gst_sunxiv4l2_parallel_rows(guint rows, guint align, guint n_threads, GstSunxiV4l2RowFunc func, gpointer user_data)
+{
+    RowTask tasks[SUNXI_V4L2_MAX_WORKERS];
+    RowSync sync;
+    GThreadPool *pool;
+    guint i, n, slice;
+
+    n_threads = CLAMP(n_threads, 1, SUNXI_V4L2_MAX_WORKERS);
+    align = MAX(align, 1);
+    pool = n_threads > 1 ? row_pool_get() : NULL;
+
+    slice = (rows + n_threads - 1) / n_threads;
+    slice = (slice + align - 1) / align * align;
+
+    if (!pool || slice >= rows) {
+        func(user_data, 0, rows);
+        return;
+    }
+
+    g_mutex_init(&sync.lock);
+    g_cond_init(&sync.cond);
+    sync.pending = 0;
+
+    for (n = 0; n * slice < rows; n++) {
+        tasks[n].func = func;
+        tasks[n].user_data = user_data;
+        tasks[n].row_start = n * slice;
+        tasks[n].row_end = MIN(rows, (n + 1) * slice);
+        tasks[n].sync = &sync;
+    }
+
+    sync.pending = n - 1;
+
+    for (i = 1; i < n; i++)
+        g_thread_pool_push(pool, &tasks[i], NULL);
+
+    func(user_data, tasks[0].row_start, tasks[0].row_end);
+
+    g_mutex_lock(&sync.lock);
+    while (sync.pending > 0)
+        g_cond_wait(&sync.cond, &sync.lock);
+    g_mutex_unlock(&sync.lock);
+
+    g_cond_clear(&sync.cond);
+    g_mutex_clear(&sync.lock);
+}
+
+typedef struct {
+    const GstVideoInfo *in_info;
+    const guint8 *src;
+    const GstVideoInfo *out_info;
+    guint8 *dst;
+} RepackCtx;
+
+#define PLANE_IN(ctx, p, row) \
+    ((ctx)->src + GST_VIDEO_INFO_PLANE_OFFSET((ctx)->in_info, p) + \
+     (gsize)(row) * GST_VIDEO_INFO_PLANE_STRIDE((ctx)->in_info, p))
+#define PLANE_OUT(ctx, p, row) \
+    ((ctx)->dst + GST_VIDEO_INFO_PLANE_OFFSET((ctx)->out_info, p) + \
+     (gsize)(row) * GST_VIDEO_INFO_PLANE_STRIDE((ctx)->out_info, p))
+
+/* one pass per row: luma is streamed out, chroma swizzled on the way */
+static void
+repack_rows(gpointer user_data, guint row_start, guint row_end)
+{
+    RepackCtx *ctx = user_data;
+    GstVideoFormat in_fmt = GST_VIDEO_INFO_FORMAT(ctx->in_info);
+    GstVideoFormat out_fmt = GST_VIDEO_INFO_FORMAT(ctx->out_info);
+    guint width = GST_VIDEO_INFO_WIDTH(ctx->in_info);
+    guint pairs = (width + 1) / 2;
+    guint row;
+
+    for (row = row_start; row < row_end; row++)
+        gst_sunxiv4l2_stream_copy(PLANE_OUT(ctx, 0, row), PLANE_IN(ctx, 0, row), width);
+
+    for (row = row_start / 2; row < (row_end + 1) / 2; row++) {
+        const guint8 *uv = PLANE_IN(ctx, 1, row);
+
+        if (out_fmt == GST_VIDEO_FORMAT_I420) {
+            guint8 *u = PLANE_OUT(ctx, 1, row);
+            guint8 *v = PLANE_OUT(ctx, 2, row);
+
+            if (in_fmt == GST_VIDEO_FORMAT_NV12)
+                gst_sunxiv4l2_split_uv(u, v, uv, pairs);
+            else
+                gst_sunxiv4l2_split_uv(v, u, uv, pairs);
+        } else if (out_fmt != in_fmt) {
+            gst_sunxiv4l2_swap_uv(PLANE_OUT(ctx, 1, row), uv, pairs);
+        } else {
+            gst_sunxiv4l2_stream_copy(PLANE_OUT(ctx, 1, row), uv, pairs * 2);
+        }
+    }
+}
+
+gboolean
+gst_sunxiv4l2_can_repack(GstVideoFormat in_fmt, GstVideoFormat out_fmt)
+{
+    if (in_fmt != GST_VIDEO_FORMAT_NV12 && in_fmt != GST_VIDEO_FORMAT_NV21)
+        return FALSE;
+
+    return out_fmt == GST_VIDEO_FORMAT_NV12 ||
+           out_fmt == GST_VIDEO_FORMAT_NV21 ||
+           out_fmt == GST_VIDEO_FORMAT_I420;
+}
+
+void
+gst_sunxiv4l2_repack(const GstVideoInfo *in_info, const guint8 *src,
+                     const GstVideoInfo *out_info, guint8 *dst, guint n_threads)
+{
+    RepackCtx ctx;
+    guint height = GST_VIDEO_INFO_HEIGHT(in_info);
+
+    ctx.in_info = in_info;
+    ctx.src = src;
+    ctx.out_info = out_info;
+    ctx.dst = dst;
+
+    if ((guint64)GST_VIDEO_INFO_WIDTH(in_info) * height < PARALLEL_MIN_PIXELS)
+        n_threads = 1;
+
+    /* slices start on even rows so they never share a chroma row */
+    gst_sunxiv4l2_parallel_rows(height, 2, n_threads, repack_rows, &ctx);
+}
+
+typedef struct {
+    const GstSunxiBayerFormat *bayer;
+    const GstVideoInfo *in_info;
+    const guint8 *src;
+    const GstVideoInfo *out_info;
+    guint8 *dst;
+} BayerCtx;
+
+enum { CH_R, CH_G, CH_B };
+
+/* colour of the top-left 2x2 cell for each GstSunxiBayerOrder */
+static const guint8 bayer_cells[4][2][2] = {
+    {{CH_B, CH_G}, {CH_G, CH_R}},
+    {{CH_G, CH_B}, {CH_R, CH_G}},
+    {{CH_G, CH_R}, {CH_B, CH_G}},
+    {{CH_R, CH_G}, {CH_G, CH_B}},
+};
+
+static guint
+bayer_row_bytes(const GstSunxiBayerFormat *bayer, guint width)
+{
+    if (bayer->packed)
+        return (width * bayer->depth + 7) / 8;
+
+    return width * (bayer->depth > 8 ? 2 : 1);
+}
+
+static void
+bayer_unpack_rows(gpointer user_data, guint row_start, guint row_end)
+{
+    BayerCtx *ctx = user_data;
+    guint width = GST_VIDEO_INFO_WIDTH(ctx->in_info);
+    guint row;
+
+    for (row = row_start; row < row_end; row++) {
+        guint16 *out = (guint16 *)PLANE_OUT(ctx, 0, row);
+
+        if (ctx->bayer->depth == 10)
+            gst_sunxiv4l2_unpack_raw10(out, PLANE_IN(ctx, 0, row), width);
+        else
+            gst_sunxiv4l2_unpack_raw12(out, PLANE_IN(ctx, 0, row), width);
+    }
+}
+
+void
+gst_sunxiv4l2_bayer_unpack(const GstSunxiBayerFormat *bayer,
+                           const GstVideoInfo *in_info, const guint8 *src,
+                           const GstVideoInfo *out_info, guint8 *dst, guint n_threads)
+{
+    BayerCtx ctx;
+    guint height = GST_VIDEO_INFO_HEIGHT(in_info);
+
+    ctx.bayer = bayer;
+    ctx.in_info = in_info;
+    ctx.src = src;
+    ctx.out_info = out_info;
+    ctx.dst = dst;
+
+    if ((guint64)GST_VIDEO_INFO_WIDTH(in_info) * height < PARALLEL_MIN_PIXELS)
+        n_threads = 1;
+
+    gst_sunxiv4l2_parallel_rows(height, 1, n_threads, bayer_unpack_rows, &ctx);
+}
+
+/*
+ * Fetch one sensor row as 8 bit samples into line[1..width], mirroring
+ * one sample on each side (and rows past the edges) so the neighbourhood
+ * of every pixel keeps the colour of the real one.
+ */
+static void
+bayer_load_row(BayerCtx *ctx, gint row, guint8 *line, guint8 *raw)
+{
+    const GstSunxiBayerFormat *bayer = ctx->bayer;
+    guint width = GST_VIDEO_INFO_WIDTH(ctx->in_info);
+    gint height = GST_VIDEO_INFO_HEIGHT(ctx->in_info);
+    guint x;
+
+    if (row < 0)
+        row = 1;
+    else if (row >= height)
+        row = height - 2;
+
+    if (bayer->depth == 8) {
+        gst_sunxiv4l2_stream_copy(line + 1, PLANE_IN(ctx, 0, row), width);
+    } else {
+        /* one burst over the uncached row, then pick from cached memory */
+        gst_sunxiv4l2_stream_copy(raw, PLANE_IN(ctx, 0, row), bayer_row_bytes(bayer, width));
+
+        if (!bayer->packed) {
+            const guint16 *in = (const guint16 *)raw;
+            guint shift = bayer->depth - 8;
+
+            for (x = 0; x < width; x++)
+                line[x + 1] = GUINT16_FROM_LE(in[x]) >> shift;
+        } else if (bayer->depth == 10) {
+            for (x = 0; x < width; x++)
+                line[x + 1] = raw[x / 4 * 5 + x % 4];
+        } else {
+            for (x = 0; x < width; x++)
+                line[x + 1] = raw[x / 2 * 3 + x % 2];
+        }
+    }
+
+    line[0] = line[2];
+    line[width + 1] = line[width - 1];
+}
+
+/* bilinear: average of the nearest samples of each missing colour */
+static inline void
+bayer_rgb(const guint8 *u, const guint8 *c, const guint8 *d, guint8 ch, guint8 hch, guint8 vch, gint rgb[3])
+{
+    if (ch == CH_G) {
+        rgb[CH_G] = c[0];
+        rgb[hch] = (c[-1] + c[1] + 1) >> 1;
+        rgb[vch] = (u[0] + d[0] + 1) >> 1;
+    } else {
+        rgb[ch] = c[0];
+        rgb[CH_G] = (c[-1] + c[1] + u[0] + d[0] + 2) >> 2;
+        rgb[CH_B - ch] = (u[-1] + u[1] + d[-1] + d[1] + 2) >> 2;
+    }
+}
+
+#define RGB_TO_Y(r, g, b) ((((66 * (r) + 129 * (g) + 25 * (b) + 128) >> 8) + 16))
+#define RGB_TO_U(r, g, b) ((((-38 * (r) - 74 * (g) + 112 * (b) + 128) >> 8) + 128))
+#define RGB_TO_V(r, g, b) ((((112 * (r) - 94 * (g) - 18 * (b) + 128) >> 8) + 128))
+
+/* lines[] hold sensor rows row - 1 .. row + 2, two NV12 luma rows out */
+static void
+bayer_demosaic_pair(BayerCtx *ctx, guint row, guint8 *lines[4])
+{
+    const guint8 (*cell)[2] = bayer_cells[ctx->bayer->order];
+    guint width = GST_VIDEO_INFO_WIDTH(ctx->in_info);
+    guint8 *y0 = PLANE_OUT(ctx, 0, row);
+    guint8 *y1 = PLANE_OUT(ctx, 0, row + 1);
+    guint8 *uv = PLANE_OUT(ctx, 1, row / 2);
+    guint x, r, px;
+
+    for (x = 0; x + 1 < width; x += 2) {
+        gint sum[3] = {0, 0, 0};
+
+        for (r = 0; r < 2; r++) {
+            guint8 *luma = r ? y1 : y0;
+
+            for (px = 0; px < 2; px++) {
+                guint8 ch = cell[r][px];
+                gint rgb[3];
+
+                bayer_rgb(lines[r] + 1 + x + px, lines[r + 1] + 1 + x + px, lines[r + 2] + 1 + x + px,
+                          ch, cell[r][px ^ 1], cell[r ^ 1][px], rgb);
+
+                luma[x + px] = RGB_TO_Y(rgb[CH_R], rgb[CH_G], rgb[CH_B]);
+                sum[CH_R] += rgb[CH_R];
+                sum[CH_G] += rgb[CH_G];
+                sum[CH_B] += rgb[CH_B];
+            }
+        }
+
+        sum[CH_R] = (sum[CH_R] + 2) >> 2;
+        sum[CH_G] = (sum[CH_G] + 2) >> 2;
+        sum[CH_B] = (sum[CH_B] + 2) >> 2;
+        uv[x] = RGB_TO_U(sum[CH_R], sum[CH_G], sum[CH_B]);
+        uv[x + 1] = RGB_TO_V(sum[CH_R], sum[CH_G], sum[CH_B]);
+    }
+}
+
+static void
+bayer_demosaic_rows(gpointer user_data, guint row_start, guint row_end)
+{
+    BayerCtx *ctx = user_data;
+    guint width = GST_VIDEO_INFO_WIDTH(ctx->in_info);
+    guint stride = width + 2;
+    guint8 *scratch, *raw, *lines[4], *tmp;
+    guint row, i;
+
+    scratch = g_malloc(stride * 4 + bayer_row_bytes(ctx->bayer, width));
+    raw = scratch + stride * 4;
+
+    for (i = 0; i < 4; i++)
+        lines[i] = scratch + stride * i;
+
+    bayer_load_row(ctx, (gint)row_start - 1, lines[0], raw);
+    bayer_load_row(ctx, row_start, lines[1], raw);
+
+    for (row = row_start; row + 1 < row_end; row += 2) {
+        bayer_load_row(ctx, row + 1, lines[2], raw);
+        bayer_load_row(ctx, row + 2, lines[3], raw);
+
+        bayer_demosaic_pair(ctx, row, lines);
+
+        /* the bottom two rows are the top neighbours of the next pair */
+        tmp = lines[0];
+        lines[0] = lines[2];
+        lines[2] = tmp;
+        tmp = lines[1];
+        lines[1] = lines[3];
+        lines[3] = tmp;
+    }
+
+    g_free(scratch);
+}
+
+void
+gst_sunxiv4l2_demosaic(const GstSunxiBayerFormat *bayer,
+                       const GstVideoInfo *in_info, const guint8 *src,
+                       const GstVideoInfo *out_info, guint8 *dst, guint n_threads)
+{
+    BayerCtx ctx;
+    guint height = GST_VIDEO_INFO_HEIGHT(in_info);
+
+    g_return_if_fail(GST_VIDEO_INFO_FORMAT(out_info) == GST_VIDEO_FORMAT_NV12);
+
+    ctx.bayer = bayer;
+    ctx.in_info = in_info;
+    ctx.src = src;
+    ctx.out_info = out_info;
+    ctx.dst = dst;
+
+    /* every output pair reads one row above and below, slices overlap
+     * on input only */
+    gst_sunxiv4l2_parallel_rows(height, 2, n_threads, bayer_demosaic_rows, &ctx);
+}
+
+typedef struct {
+    guint i0;
+    guint i1;
+    guint w;        /* weight of i1 in 1/256 */
+} TensorTap;
+
+typedef struct {
+    const GstVideoInfo *in_info;
+    const guint8 *src;
+    const GstSunxiTensorParams *params;
+    guint8 *dst;
+    TensorTap *luma_x;
+    TensorTap *luma_y;
+    TensorTap *chroma_x;
+    TensorTap *chroma_y;
+    guint u_off;
+    gboolean identity;
+} TensorCtx;
+
+/* pixel centres aligned, (i + 0.5) * in / out - 0.5 in 8.8 fixed point */
+static void
+tensor_taps(TensorTap *taps, guint out, guint in)
+{
+    guint i;
+
+    for (i = 0; i < out; i++) {
+        gint64 pos = (gint64)(2 * i + 1) * in * 256 / (2 * out) - 128;
+
+        pos = CLAMP(pos, 0, (gint64)(in - 1) * 256);
+        taps[i].i0 = pos >> 8;
+        taps[i].w = pos & 0xff;
+        taps[i].i1 = MIN(taps[i].i0 + 1, in - 1);
+    }
+}
+
+static inline guint8
+tensor_lerp(const guint16 *row, const TensorTap *tap, guint step, guint off)
+{
+    return (row[tap->i0 * step + off] * (256 - tap->w) + row[tap->i1 * step + off] * tap->w + 32768) >> 16;
+}
+
+/*
+ * One output row at a time: the two source rows of luma and chroma are
+ * blended vertically with SIMD into a small cached row, then sampled
+ * horizontally, converted to RGB and normalized straight into the planes.
+ */
+static void
+tensor_rows(gpointer user_data, guint row_start, guint row_end)
+{
+    TensorCtx *ctx = user_data;
+    const GstSunxiTensorParams *params = ctx->params;
+    guint width = GST_VIDEO_INFO_WIDTH(ctx->in_info);
+    guint chroma_bytes = (width + 1) / 2 * 2;
+    gsize plane = (gsize)params->width * params->height;
+    guint16 *luma, *chroma;
+    guint row, x, c;
+
+    luma = g_malloc((width + chroma_bytes) * sizeof(guint16));
+    chroma = luma + width;
+
+    for (row = row_start; row < row_end; row++) {
+        const TensorTap *ly = &ctx->luma_y[row];
+        const TensorTap *cy = &ctx->chroma_y[row];
+        gsize base = (gsize)row * params->width;
+
+        gst_sunxiv4l2_blend_rows(luma, PLANE_IN(ctx, 0, ly->i0), PLANE_IN(ctx, 0, ly->i1), ly->w, width);
+        gst_sunxiv4l2_blend_rows(chroma, PLANE_IN(ctx, 1, cy->i0), PLANE_IN(ctx, 1, cy->i1), cy->w, chroma_bytes);
+
+        for (x = 0; x < params->width; x++) {
+            gint y = tensor_lerp(luma, &ctx->luma_x[x], 1, 0);
+            gint u = tensor_lerp(chroma, &ctx->chroma_x[x], 2, ctx->u_off) - 128;
+            gint v = tensor_lerp(chroma, &ctx->chroma_x[x], 2, ctx->u_off ^ 1) - 128;
+            gint luma_term = 298 * (y - 16) + 128;
+            gint rgb[3];
+
+            rgb[0] = CLAMP((luma_term + 409 * v) >> 8, 0, 255);
+            rgb[1] = CLAMP((luma_term - 100 * u - 208 * v) >> 8, 0, 255);
+            rgb[2] = CLAMP((luma_term + 516 * u) >> 8, 0, 255);
+
+            for (c = 0; c < 3; c++) {
+                gsize idx = c * plane + base + x;
+
+                if (params->type == GST_SUNXI_TENSOR_FLOAT32) {
+                    ((gfloat *)ctx->dst)[idx] = (rgb[c] - params->mean[c]) * params->scale[c];
+                } else if (ctx->identity) {
+                    ctx->dst[idx] = rgb[c];
+                } else {
+                    gint n = (gint)((rgb[c] - params->mean[c]) * params->scale[c] + 0.5f);
+
+                    ctx->dst[idx] = CLAMP(n, 0, 255);
+                }
+            }
+        }
+    }
+
+    g_free(luma);
+}
+
+gsize
+gst_sunxiv4l2_tensor_size(const GstSunxiTensorParams *params)
+{
+    gsize elem = params->type == GST_SUNXI_TENSOR_FLOAT32 ? sizeof(gfloat) : 1;
+
+    return (gsize)params->width * params->height * 3 * elem;
+}
+
+/* NV12/NV21 to planar RGB (CHW) of params->width x params->height */
+void
+gst_sunxiv4l2_tensor(const GstVideoInfo *in_info, const guint8 *src,
+                     const GstSunxiTensorParams *params, guint8 *dst, guint n_threads)
+{
+    TensorCtx ctx;
+    guint width = GST_VIDEO_INFO_WIDTH(in_info);
+    guint height = GST_VIDEO_INFO_HEIGHT(in_info);
+    TensorTap *taps;
+    guint c;
+
+    g_return_if_fail(GST_VIDEO_INFO_FORMAT(in_info) == GST_VIDEO_FORMAT_NV12 ||
+                     GST_VIDEO_INFO_FORMAT(in_info) == GST_VIDEO_FORMAT_NV21);
+
+    taps = g_new(TensorTap, (params->width + params->height) * 2);
+
+    ctx.in_info = in_info;
+    ctx.src = src;
+    ctx.params = params;
+    ctx.dst = dst;
+    ctx.luma_x = taps;
+    ctx.chroma_x = ctx.luma_x + params->width;
+    ctx.luma_y = ctx.chroma_x + params->width;
+    ctx.chroma_y = ctx.luma_y + params->height;
+    ctx.u_off = GST_VIDEO_INFO_FORMAT(in_info) == GST_VIDEO_FORMAT_NV21 ? 1 : 0;
+    ctx.identity = TRUE;
+
+    for (c = 0; c < 3; c++) {
+        if (params->mean[c] != 0.0f || params->scale[c] != 1.0f)
+            ctx.identity = FALSE;
+    }
+
+    tensor_taps(ctx.luma_x, params->width, width);
+    tensor_taps(ctx.chroma_x, params->width, (width + 1) / 2);
+    tensor_taps(ctx.luma_y, params->height, height);
+    tensor_taps(ctx.chroma_y, params->height, (height + 1) / 2);
+
+    gst_sunxiv4l2_parallel_rows(params->height, 1, n_threads, tensor_rows, &ctx);
+
+    g_free(taps);
+}
+
+typedef struct {
+    const GstVideoInfo *in_info;
+    const guint8 *src;
+    const GstVideoInfo *out_info;
+    guint8 *dst;
+    guint factor;
+} BoxCtx;
+
+/* average factor x factor blocks of `channels` interleaved samples */
+static void
+box_plane_row(const BoxCtx *ctx, guint plane, guint out_row, guint channels, guint16 *acc)
+{
+    guint factor = ctx->factor;
+    guint out_w = GST_VIDEO_INFO_COMP_WIDTH(ctx->out_info, plane);
+    guint span = out_w * factor * channels;
+    guint area = factor * factor;
+    guint8 *out = PLANE_OUT(ctx, plane, out_row);
+    guint k, x, c, j;
+
+    memset(acc, 0, span * sizeof(guint16));
+
+    for (k = 0; k < factor; k++)
+        gst_sunxiv4l2_accumulate_row(acc, PLANE_IN(ctx, plane, out_row * factor + k), span);
+
+    for (x = 0; x < out_w; x++) {
+        for (c = 0; c < channels; c++) {
+            const guint16 *a = acc + x * factor * channels + c;
+            guint sum = 0;
+
+            for (j = 0; j < factor; j++)
+                sum += a[j * channels];
+
+            out[x * channels + c] = (sum + area / 2) / area;
+        }
+    }
+}
+
+static void
+box_rows(gpointer user_data, guint row_start, guint row_end)
+{
+    BoxCtx *ctx = user_data;
+    guint16 *acc;
+    guint row;
+
+    acc = g_malloc(GST_VIDEO_INFO_PLANE_STRIDE(ctx->in_info, 0) * sizeof(guint16));
+
+    for (row = row_start; row < row_end; row++) {
+        box_plane_row(ctx, 0, row, 1, acc);
+
+        /* slices start on even rows, each chroma row is done once */
+        if (!(row & 1))
+            box_plane_row(ctx, 1, row / 2, 2, acc);
+    }
+
+    g_free(acc);
+}
+
+/* NV12/NV21 box filtered by an integer factor into out_info (same format) */
+void
+gst_sunxiv4l2_box_downscale(const GstVideoInfo *in_info, const guint8 *src,
+                            const GstVideoInfo *out_info, guint8 *dst,
+                            guint factor, guint n_threads)
+{
+    BoxCtx ctx;
+
+    g_return_if_fail(factor > 0 && factor <= 16);
+    g_return_if_fail(GST_VIDEO_INFO_FORMAT(in_info) == GST_VIDEO_INFO_FORMAT(out_info));
+
+    ctx.in_info = in_info;
+    ctx.src = src;
+    ctx.out_info = out_info;
+    ctx.dst = dst;
+    ctx.factor = factor;
+
+    gst_sunxiv4l2_parallel_rows(GST_VIDEO_INFO_HEIGHT(out_info), 2, n_threads, box_rows, &ctx);
+}
+
+/* mean absolute difference per sample above which a block counts as moving */
+#define LUMA_MOTION_THRESHOLD 12
+
+struct _GstSunxiLumaAnalyzer {
+    guint step;
+    guint width;
+    guint rows;
+    guint8 *cur;
+    guint8 *prev;
+    guint32 *block_sad;
+    gboolean has_prev;
+};
+
+/* any layout with 8 bit luma alone in plane 0 */
+gboolean
+gst_sunxiv4l2_luma_supported(const GstVideoInfo *info)
+{
+    return GST_VIDEO_INFO_IS_YUV(info) &&
+        GST_VIDEO_INFO_COMP_DEPTH(info, 0) == 8 &&
+        GST_VIDEO_INFO_COMP_PSTRIDE(info, 0) == 1;
+}
+
+GstSunxiLumaAnalyzer *
+gst_sunxiv4l2_luma_analyzer_new(guint step)
+{
+    GstSunxiLumaAnalyzer *analyzer = g_new0(GstSunxiLumaAnalyzer, 1);
+
+    analyzer->step = MAX(step, 1);
+
+    return analyzer;
+}
+
+void
+gst_sunxiv4l2_luma_analyzer_free(GstSunxiLumaAnalyzer *analyzer)
+{
+    if (!analyzer)
+        return;
+
+    g_free(analyzer->cur);
+    g_free(analyzer->prev);
+    g_free(analyzer->block_sad);
+    g_free(analyzer);
+}
+
+/* forget the previous frame, the next one reports no motion */
+void
+gst_sunxiv4l2_luma_analyzer_reset(GstSunxiLumaAnalyzer *analyzer)
+{
+    if (!analyzer)
+        return;
+
+    analyzer->has_prev = FALSE;
+}
+
+/* keep diffing against the reference of the last analyze() call */
+void
+gst_sunxiv4l2_luma_analyzer_hold(GstSunxiLumaAnalyzer *analyzer)
+{
+    guint8 *tmp = analyzer->prev;
+
+    analyzer->prev = analyzer->cur;
+    analyzer->cur = tmp;
+}
+
+/*
+ * Every step-th row of the Y plane is streamed into a cached copy, which
+ * feeds the SIMD sum/SAD kernel and, at every step-th column, the histogram.
+ * The copy is kept to diff the next frame against.
+ *
+ * Returns the largest mean absolute difference of a block, -1 without a
+ * previous frame.
+ */
+gdouble
+gst_sunxiv4l2_luma_analyze(GstSunxiLumaAnalyzer *analyzer, const GstVideoInfo *info,
+                           const guint8 *src, GstSunxiLumaStats *stats)
+{
+    guint step = analyzer->step;
+    guint width = GST_VIDEO_INFO_COMP_WIDTH(info, 0);
+    guint rows = (GST_VIDEO_INFO_COMP_HEIGHT(info, 0) + step - 1) / step;
+    guint group = MAX(16 / step, 1);
+    guint blocks_x = (width + 15) / 16;
+    guint blocks_y = (rows + group - 1) / group;
+    guint64 sum = 0, sumsq = 0, sad = 0;
+    guint moving = 0;
+    gdouble max_diff = -1.0;
+    guint8 *tmp;
+    guint r, x, b;
+
+    memset(stats, 0, sizeof(*stats));
+
+    if (!width || !rows)
+        return max_diff;
+
+    if (analyzer->width != width || analyzer->rows != rows) {
+        g_free(analyzer->cur);
+        g_free(analyzer->prev);
+        g_free(analyzer->block_sad);
+        analyzer->cur = g_malloc(width * rows);
+        analyzer->prev = g_malloc(width * rows);
+        analyzer->block_sad = g_malloc(blocks_x * blocks_y * sizeof(guint32));
+        analyzer->width = width;
+        analyzer->rows = rows;
+        analyzer->has_prev = FALSE;
+    }
+
+    memset(analyzer->block_sad, 0, blocks_x * blocks_y * sizeof(guint32));
+
+    for (r = 0; r < rows; r++) {
+        guint8 *row = analyzer->cur + r * width;
+
+        gst_sunxiv4l2_stream_copy(row, src + GST_VIDEO_INFO_PLANE_OFFSET(info, 0) +
+            r * step * GST_VIDEO_INFO_PLANE_STRIDE(info, 0), width);
+
+        gst_sunxiv4l2_luma_row_stats(row,
+            analyzer->has_prev ? analyzer->prev + r * width : NULL, width,
+            &sum, &sumsq, analyzer->block_sad + (r / group) * blocks_x);
+
+        for (x = 0; x < width; x += step)
+            stats->histogram[row[x] * GST_SUNXI_LUMA_BINS / 256]++;
+    }
+
+    stats->samples = ((width + step - 1) / step) * rows;
+    stats->mean = (gdouble)sum / (width * rows);
+    stats->variance = MAX((gdouble)sumsq / (width * rows) - stats->mean * stats->mean, 0.0);
+
+    if (analyzer->has_prev) {
+        for (b = 0; b < blocks_x * blocks_y; b++) {
+            guint bx = b % blocks_x, by = b / blocks_x;
+            guint area = MIN(16, width - bx * 16) * MIN(group, rows - by * group);
+
+            sad += analyzer->block_sad[b];
+            if (analyzer->block_sad[b] > LUMA_MOTION_THRESHOLD * area)
+                moving++;
+
+            max_diff = MAX(max_diff, (gdouble)analyzer->block_sad[b] / area);
+        }
+
+        stats->sad = (gdouble)sad / (width * rows);
+        stats->motion = (gdouble)moving / (blocks_x * blocks_y);
+    }
+
+    tmp = analyzer->prev;
+    analyzer->prev = analyzer->cur;
+    analyzer->cur = tmp;
+    analyzer->has_prev = TRUE;
+
+    return max_diff;
+}
+
+/* copy the out_info sized window at (x, y) of every plane, x and y even */
+void
+gst_sunxiv4l2_crop(const GstVideoInfo *in_info, const guint8 *src, guint x, guint y,
+                   const GstVideoInfo *out_info, guint8 *dst)
+{
+    const GstVideoFormatInfo *finfo = in_info->finfo;
+    guint plane, comp, row;
+
+    g_return_if_fail(GST_VIDEO_INFO_FORMAT(in_info) == GST_VIDEO_INFO_FORMAT(out_info));
+
+    for (plane = 0; plane < GST_VIDEO_INFO_N_PLANES(in_info); plane++) {
+        guint pstride, bytes, rows;
+        gsize skip;
+
+        for (comp = 0; comp < GST_VIDEO_INFO_N_COMPONENTS(in_info); comp++) {
+            if (GST_VIDEO_INFO_COMP_PLANE(in_info, comp) == plane)
+                break;
+        }
+
+        pstride = GST_VIDEO_INFO_COMP_PSTRIDE(in_info, comp);
+        bytes = GST_VIDEO_INFO_COMP_WIDTH(out_info, comp) * pstride;
+        rows = GST_VIDEO_INFO_COMP_HEIGHT(out_info, comp);
+        skip = GST_VIDEO_INFO_PLANE_OFFSET(in_info, plane) +
+            GST_VIDEO_FORMAT_INFO_SCALE_HEIGHT(finfo, comp, y) * GST_VIDEO_INFO_PLANE_STRIDE(in_info, plane) +
+            GST_VIDEO_FORMAT_INFO_SCALE_WIDTH(finfo, comp, x) * pstride;
+
+        for (row = 0; row < rows; row++)
+            gst_sunxiv4l2_stream_copy(dst + GST_VIDEO_INFO_PLANE_OFFSET(out_info, plane) +
+                row * GST_VIDEO_INFO_PLANE_STRIDE(out_info, plane),
+                src + skip + row * GST_VIDEO_INFO_PLANE_STRIDE(in_info, plane), bytes);
+    }
+}
+
+typedef struct {
+    const GstVideoInfo *info;
+    const guint8 *src;
+    guint8 *dst;
+    gboolean hflip;
+    gboolean vflip;
+} FlipCtx;
+
+static void
+flip_rows(gpointer user_data, guint row_start, guint row_end)
+{
+    FlipCtx *ctx = user_data;
+    const GstVideoInfo *info = ctx->info;
+    guint height = GST_VIDEO_INFO_HEIGHT(info);
+    guint plane, comp, row;
+
+    for (plane = 0; plane < GST_VIDEO_INFO_N_PLANES(info); plane++) {
+        guint pstride, width, rows;
+
+        for (comp = 0; comp < GST_VIDEO_INFO_N_COMPONENTS(info); comp++) {
+            if (GST_VIDEO_INFO_COMP_PLANE(info, comp) == plane)
+                break;
+        }
+
+        pstride = GST_VIDEO_INFO_COMP_PSTRIDE(info, comp);
+        width = GST_VIDEO_INFO_COMP_WIDTH(info, comp);
+        rows = GST_VIDEO_INFO_COMP_HEIGHT(info, comp);
+
+        /* slices are in luma rows, subsampled planes follow proportionally */
+        for (row = row_start * rows / height; row < row_end * rows / height; row++) {
+            guint src_row = ctx->vflip ? rows - 1 - row : row;
+            guint8 *out = ctx->dst + GST_VIDEO_INFO_PLANE_OFFSET(info, plane) +
+                row * GST_VIDEO_INFO_PLANE_STRIDE(info, plane);
+            const guint8 *in = ctx->src + GST_VIDEO_INFO_PLANE_OFFSET(info, plane) +
+                src_row * GST_VIDEO_INFO_PLANE_STRIDE(info, plane);
+
+            if (ctx->hflip)
+                gst_sunxiv4l2_reverse_row(out, in, width, pstride);
+            else
+                gst_sunxiv4l2_stream_copy(out, in, width * pstride);
+        }
+    }
+}
+
+/* planar and semi-planar 8 bit layouts, every plane's samples are whole pixels */
+gboolean
+gst_sunxiv4l2_can_flip(GstVideoFormat format)
+{
+    switch (format) {
+    case GST_VIDEO_FORMAT_NV12:
+    case GST_VIDEO_FORMAT_NV21:
+    case GST_VIDEO_FORMAT_NV16:
+    case GST_VIDEO_FORMAT_NV61:
+    case GST_VIDEO_FORMAT_I420:
+    case GST_VIDEO_FORMAT_YV12:
+    case GST_VIDEO_FORMAT_GRAY8:
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+void
+gst_sunxiv4l2_flip(const GstVideoInfo *info, const guint8 *src, guint8 *dst,
+                   gboolean hflip, gboolean vflip, guint n_threads)
+{
+    FlipCtx ctx;
+
+    g_return_if_fail(gst_sunxiv4l2_can_flip(GST_VIDEO_INFO_FORMAT(info)));
+
+    ctx.info = info;
+    ctx.src = src;
+    ctx.dst = dst;
+    ctx.hflip = hflip;
+    ctx.vflip = vflip;
+
+    gst_sunxiv4l2_parallel_rows(GST_VIDEO_INFO_HEIGHT(info), 2, n_threads, flip_rows, &ctx);
+}
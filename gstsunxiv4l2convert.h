@@ -0,0 +1,68 @@
+#ifndef _GST_SUNXIV4L2_CONVERT_H
+#define _GST_SUNXIV4L2_CONVERT_H
+
+#include <gst/gst.h>
+#include <gst/video/video-info.h>
+
+#include "gstsunxiv4l2.h"
+#include "gstsunxiv4l2meta.h"
+
+#define SUNXI_V4L2_MAX_WORKERS 4
+
+typedef enum {
+    GST_SUNXI_TENSOR_NONE,
+    GST_SUNXI_TENSOR_UINT8,
+    GST_SUNXI_TENSOR_FLOAT32,
+} GstSunxiTensorType;
+
+/* planar RGB, every channel mapped to (value - mean) * scale */
+typedef struct {
+    GstSunxiTensorType type;
+    guint width;
+    guint height;
+    gfloat mean[3];
+    gfloat scale[3];
+} GstSunxiTensorParams;
+
+typedef struct _GstSunxiLumaAnalyzer GstSunxiLumaAnalyzer;
+
+typedef void (*GstSunxiV4l2RowFunc)(gpointer user_data, guint row_start, guint row_end);
+
+guint gst_sunxiv4l2_default_threads(void);
+void gst_sunxiv4l2_parallel_rows(guint rows, guint align, guint n_threads, GstSunxiV4l2RowFunc func, gpointer user_data);
+
+gboolean gst_sunxiv4l2_can_repack(GstVideoFormat in_fmt, GstVideoFormat out_fmt);
+void gst_sunxiv4l2_repack(const GstVideoInfo *in_info, const guint8 *src,
+                          const GstVideoInfo *out_info, guint8 *dst, guint n_threads);
+
+void gst_sunxiv4l2_bayer_unpack(const GstSunxiBayerFormat *bayer,
+                                const GstVideoInfo *in_info, const guint8 *src,
+                                const GstVideoInfo *out_info, guint8 *dst, guint n_threads);
+void gst_sunxiv4l2_demosaic(const GstSunxiBayerFormat *bayer,
+                            const GstVideoInfo *in_info, const guint8 *src,
+                            const GstVideoInfo *out_info, guint8 *dst, guint n_threads);
+
+void gst_sunxiv4l2_box_downscale(const GstVideoInfo *in_info, const guint8 *src,
+                                 const GstVideoInfo *out_info, guint8 *dst,
+                                 guint factor, guint n_threads);
+
+gsize gst_sunxiv4l2_tensor_size(const GstSunxiTensorParams *params);
+void gst_sunxiv4l2_tensor(const GstVideoInfo *in_info, const guint8 *src,
+                          const GstSunxiTensorParams *params, guint8 *dst, guint n_threads);
+
+void gst_sunxiv4l2_crop(const GstVideoInfo *in_info, const guint8 *src, guint x, guint y,
+                        const GstVideoInfo *out_info, guint8 *dst);
+
+gboolean gst_sunxiv4l2_can_flip(GstVideoFormat format);
+void gst_sunxiv4l2_flip(const GstVideoInfo *info, const guint8 *src, guint8 *dst,
+                        gboolean hflip, gboolean vflip, guint n_threads);
+
+gboolean gst_sunxiv4l2_luma_supported(const GstVideoInfo *info);
+GstSunxiLumaAnalyzer *gst_sunxiv4l2_luma_analyzer_new(guint step);
+void gst_sunxiv4l2_luma_analyzer_free(GstSunxiLumaAnalyzer *analyzer);
+void gst_sunxiv4l2_luma_analyzer_reset(GstSunxiLumaAnalyzer *analyzer);
+void gst_sunxiv4l2_luma_analyzer_hold(GstSunxiLumaAnalyzer *analyzer);
+gdouble gst_sunxiv4l2_luma_analyze(GstSunxiLumaAnalyzer *analyzer, const GstVideoInfo *info,
+                                   const guint8 *src, GstSunxiLumaStats *stats);
+
+#endif
@@ -0,0 +1,149 @@
+#include <string.h>
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+#include "gstsunxiv4l2meta.h"
+
+GType
+gst_sunxi_luma_meta_api_get_type(void)
+{
+    static gsize type = 0;
+    static const gchar *tags[] = { GST_META_TAG_VIDEO_STR, NULL };
+
+    if (g_once_init_enter(&type)) {
+        GType _type = gst_meta_api_type_register("GstSunxiLumaMetaAPI", tags);
+
+        g_once_init_leave(&type, _type);
+    }
+
+    return type;
+}
+
+static gboolean
+sunxi_luma_meta_init(GstMeta *meta, gpointer params, GstBuffer *buffer)
+{
+    GstSunxiLumaMeta *luma = (GstSunxiLumaMeta *)meta;
+
+    memset(&luma->stats, 0, sizeof(luma->stats));
+
+    return TRUE;
+}
+
+static gboolean
+sunxi_luma_meta_transform(GstBuffer *dest, GstMeta *meta, GstBuffer *buffer,
+                          GQuark type, gpointer data)
+{
+    GstSunxiLumaMeta *luma = (GstSunxiLumaMeta *)meta;
+
+    /* only valid for the same pixels, drop it on anything but a full copy */
+    if (GST_META_TRANSFORM_IS_COPY(type)) {
+        GstMetaTransformCopy *copy = data;
+
+        if (!copy->region)
+            gst_buffer_add_sunxi_luma_meta(dest, &luma->stats);
+    }
+
+    return TRUE;
+}
+
+const GstMetaInfo *
+gst_sunxi_luma_meta_get_info(void)
+{
+    static const GstMetaInfo *info = NULL;
+
+    if (g_once_init_enter((GstMetaInfo **)&info)) {
+        const GstMetaInfo *meta = gst_meta_register(GST_SUNXI_LUMA_META_API_TYPE,
+            "GstSunxiLumaMeta", sizeof(GstSunxiLumaMeta),
+            sunxi_luma_meta_init, NULL, sunxi_luma_meta_transform);
+
+        g_once_init_leave((GstMetaInfo **)&info, (GstMetaInfo *)meta);
+    }
+
+    return info;
+}
+
+GstSunxiLumaMeta *
+gst_buffer_add_sunxi_luma_meta(GstBuffer *buffer, const GstSunxiLumaStats *stats)
+{
+    GstSunxiLumaMeta *meta;
+
+    g_return_val_if_fail(GST_IS_BUFFER(buffer), NULL);
+
+    meta = (GstSunxiLumaMeta *)gst_buffer_add_meta(buffer, GST_SUNXI_LUMA_META_INFO, NULL);
+    if (meta && stats)
+        meta->stats = *stats;
+
+    return meta;
+}
+
+GType
+gst_sunxi_capture_meta_api_get_type(void)
+{
+    static gsize type = 0;
+    static const gchar *tags[] = { NULL };
+
+    if (g_once_init_enter(&type)) {
+        GType _type = gst_meta_api_type_register("GstSunxiCaptureMetaAPI", tags);
+
+        g_once_init_leave(&type, _type);
+    }
+
+    return type;
+}
+
+static gboolean
+sunxi_capture_meta_init(GstMeta *meta, gpointer params, GstBuffer *buffer)
+{
+    GstSunxiCaptureMeta *capture = (GstSunxiCaptureMeta *)meta;
+
+    memset(&capture->info, 0, sizeof(capture->info));
+    capture->info.timestamp = GST_CLOCK_TIME_NONE;
+    capture->info.index = -1;
+    capture->info.exposure = -1;
+    capture->info.gain = -1;
+
+    return TRUE;
+}
+
+static gboolean
+sunxi_capture_meta_transform(GstBuffer *dest, GstMeta *meta, GstBuffer *buffer,
+                             GQuark type, gpointer data)
+{
+    GstSunxiCaptureMeta *capture = (GstSunxiCaptureMeta *)meta;
+
+    /* describes the capture, not the pixels, so it survives any transform */
+    gst_buffer_add_sunxi_capture_meta(dest, &capture->info);
+
+    return TRUE;
+}
+
+const GstMetaInfo *
+gst_sunxi_capture_meta_get_info(void)
+{
+    static const GstMetaInfo *info = NULL;
+
+    if (g_once_init_enter((GstMetaInfo **)&info)) {
+        const GstMetaInfo *meta = gst_meta_register(GST_SUNXI_CAPTURE_META_API_TYPE,
+            "GstSunxiCaptureMeta", sizeof(GstSunxiCaptureMeta),
+            sunxi_capture_meta_init, NULL, sunxi_capture_meta_transform);
+
+        g_once_init_leave((GstMetaInfo **)&info, (GstMetaInfo *)meta);
+    }
+
+    return info;
+}
+
+GstSunxiCaptureMeta *
+gst_buffer_add_sunxi_capture_meta(GstBuffer *buffer, const GstSunxiCaptureInfo *info)
+{
+    GstSunxiCaptureMeta *meta;
+
+    g_return_val_if_fail(GST_IS_BUFFER(buffer), NULL);
+
+    meta = (GstSunxiCaptureMeta *)gst_buffer_add_meta(buffer, GST_SUNXI_CAPTURE_META_INFO, NULL);
+    if (meta && info)
+        meta->info = *info;
+
+    return meta;
+}
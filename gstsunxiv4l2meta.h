@@ -0,0 +1,72 @@
+#ifndef _GST_SUNXIV4L2_META_H
+#define _GST_SUNXIV4L2_META_H
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_SUNXI_LUMA_BINS 32
+
+/*
+ * Luma statistics of a strided subsample of the Y plane. sad is the mean
+ * absolute difference to the previous frame and motion the fraction of
+ * 16x16 blocks that changed, both 0 on the first frame after (re)start.
+ */
+typedef struct {
+    guint histogram[GST_SUNXI_LUMA_BINS];
+    guint samples;
+    gdouble mean;
+    gdouble variance;
+    gdouble sad;
+    gdouble motion;
+} GstSunxiLumaStats;
+
+typedef struct {
+    GstMeta meta;
+    GstSunxiLumaStats stats;
+} GstSunxiLumaMeta;
+
+#define GST_SUNXI_LUMA_META_API_TYPE (gst_sunxi_luma_meta_api_get_type())
+#define GST_SUNXI_LUMA_META_INFO (gst_sunxi_luma_meta_get_info())
+#define gst_buffer_get_sunxi_luma_meta(b) \
+    ((GstSunxiLumaMeta *)gst_buffer_get_meta((b), GST_SUNXI_LUMA_META_API_TYPE))
+
+GType gst_sunxi_luma_meta_api_get_type(void);
+const GstMetaInfo *gst_sunxi_luma_meta_get_info(void);
+GstSunxiLumaMeta *gst_buffer_add_sunxi_luma_meta(GstBuffer *buffer, const GstSunxiLumaStats *stats);
+
+/* reference of the GstReferenceTimestampMeta holding the driver timestamp */
+#define GST_SUNXI_CAPTURE_REFERENCE_MONOTONIC "timestamp/x-linux-monotonic"
+
+/*
+ * What the driver reported for the frame. flags are the raw v4l2_buffer
+ * flags (timestamp type and source included), exposure and gain are -1
+ * unless the ISP provides them.
+ */
+typedef struct {
+    guint32 sequence;
+    GstClockTime timestamp;
+    guint32 flags;
+    guint32 field;
+    gint index;
+    gint exposure;
+    gint gain;
+} GstSunxiCaptureInfo;
+
+typedef struct {
+    GstMeta meta;
+    GstSunxiCaptureInfo info;
+} GstSunxiCaptureMeta;
+
+#define GST_SUNXI_CAPTURE_META_API_TYPE (gst_sunxi_capture_meta_api_get_type())
+#define GST_SUNXI_CAPTURE_META_INFO (gst_sunxi_capture_meta_get_info())
+#define gst_buffer_get_sunxi_capture_meta(b) \
+    ((GstSunxiCaptureMeta *)gst_buffer_get_meta((b), GST_SUNXI_CAPTURE_META_API_TYPE))
+
+GType gst_sunxi_capture_meta_api_get_type(void);
+const GstMetaInfo *gst_sunxi_capture_meta_get_info(void);
+GstSunxiCaptureMeta *gst_buffer_add_sunxi_capture_meta(GstBuffer *buffer, const GstSunxiCaptureInfo *info);
+
+G_END_DECLS
+
+#endif
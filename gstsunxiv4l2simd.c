@@ -0,0 +1,401 @@
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#include "gstsunxiv4l2simd.h"
+
+#define PREFETCH_DISTANCE 256
+
+/*
+ * Capture buffers of the VIN are usually mapped uncached or write-combined,
+ * where a plain memcpy degrades to single beat reads. Read them in large
+ * sequential chunks and prefetch ahead so the bus sees bursts. The
+ * destination is cached system memory. x86 capture memory is cacheable
+ * and libc's memcpy beats any loop here, so it is used as it is.
+ */
+void
+gst_sunxiv4l2_stream_copy(gpointer dst, gconstpointer src, gsize size)
+{
+    guint8 *d = dst;
+    const guint8 *s = src;
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    gsize head;
+
+    head = (16 - ((uintptr_t)s & 15)) & 15;
+    head = MIN(head, size);
+    memcpy(d, s, head);
+    d += head;
+    s += head;
+    size -= head;
+
+    while (size >= 64) {
+        uint8x16_t a, b, c, e;
+
+        __builtin_prefetch(s + PREFETCH_DISTANCE);
+        a = vld1q_u8(s);
+        b = vld1q_u8(s + 16);
+        c = vld1q_u8(s + 32);
+        e = vld1q_u8(s + 48);
+        vst1q_u8(d, a);
+        vst1q_u8(d + 16, b);
+        vst1q_u8(d + 32, c);
+        vst1q_u8(d + 48, e);
+
+        s += 64;
+        d += 64;
+        size -= 64;
+    }
+#endif
+
+    memcpy(d, s, size);
+}
+
+/* NV12 <-> NV21: swap every interleaved chroma byte pair */
+void
+gst_sunxiv4l2_swap_uv(guint8 *dst, const guint8 *src, gsize pairs)
+{
+    gsize i = 0;
+
+#if defined(__SSE2__)
+    for (; i + 16 <= pairs; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + i * 2));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + i * 2 + 16));
+
+        a = _mm_or_si128(_mm_slli_epi16(a, 8), _mm_srli_epi16(a, 8));
+        b = _mm_or_si128(_mm_slli_epi16(b, 8), _mm_srli_epi16(b, 8));
+        _mm_storeu_si128((__m128i *)(dst + i * 2), a);
+        _mm_storeu_si128((__m128i *)(dst + i * 2 + 16), b);
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; i + 16 <= pairs; i += 16) {
+        uint8x16x2_t uv = vld2q_u8(src + i * 2);
+        uint8x16x2_t vu;
+
+        vu.val[0] = uv.val[1];
+        vu.val[1] = uv.val[0];
+        vst2q_u8(dst + i * 2, vu);
+    }
+#endif
+
+    for (; i < pairs; i++) {
+        guint8 a = src[i * 2];
+
+        dst[i * 2] = src[i * 2 + 1];
+        dst[i * 2 + 1] = a;
+    }
+}
+
+/* interleaved chroma to two planes: even bytes to dst_a, odd bytes to dst_b */
+void
+gst_sunxiv4l2_split_uv(guint8 *dst_a, guint8 *dst_b, const guint8 *src, gsize pairs)
+{
+    gsize i = 0;
+
+#if defined(__SSE2__)
+    const __m128i mask = _mm_set1_epi16(0x00ff);
+
+    for (; i + 16 <= pairs; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + i * 2));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + i * 2 + 16));
+
+        _mm_storeu_si128((__m128i *)(dst_a + i),
+            _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask)));
+        _mm_storeu_si128((__m128i *)(dst_b + i),
+            _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; i + 16 <= pairs; i += 16) {
+        uint8x16x2_t uv = vld2q_u8(src + i * 2);
+
+        vst1q_u8(dst_a + i, uv.val[0]);
+        vst1q_u8(dst_b + i, uv.val[1]);
+    }
+#endif
+
+    for (; i < pairs; i++) {
+        dst_a[i] = src[i * 2];
+        dst_b[i] = src[i * 2 + 1];
+    }
+}
+
+/*
+ * MIPI CSI-2 RAW10: 4 pixels in 5 bytes, the first four bytes hold bits
+ * 9:2 of each pixel, the fifth their bits 1:0 (pixel 0 in the low bits).
+ */
+void
+gst_sunxiv4l2_unpack_raw10(guint16 *dst, const guint8 *src, gsize pixels)
+{
+    gsize i = 0;
+
+#if defined(__SSE4_1__)
+    const __m128i msb_idx = _mm_setr_epi8(0, -1, 1, -1, 2, -1, 3, -1, 5, -1, 6, -1, 7, -1, 8, -1);
+    const __m128i lsb_idx = _mm_setr_epi8(4, -1, 4, -1, 4, -1, 4, -1, 9, -1, 9, -1, 9, -1, 9, -1);
+    const __m128i lsb_mul = _mm_setr_epi16(64, 16, 4, 1, 64, 16, 4, 1);
+    const __m128i lsb_mask = _mm_set1_epi16(0xc0);
+
+    /* 8 pixels per step, the 16 byte load needs 6 bytes of slack */
+    for (; i + 16 <= pixels; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i / 4 * 5));
+        __m128i hi = _mm_slli_epi16(_mm_shuffle_epi8(v, msb_idx), 2);
+        __m128i lo = _mm_mullo_epi16(_mm_shuffle_epi8(v, lsb_idx), lsb_mul);
+
+        lo = _mm_srli_epi16(_mm_and_si128(lo, lsb_mask), 6);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(hi, lo));
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    static const guint8 msb_tbl[8] = {0, 1, 2, 3, 5, 6, 7, 8};
+    static const guint8 lsb_tbl[8] = {4, 4, 4, 4, 9, 9, 9, 9};
+    static const int16_t lsb_shift[8] = {0, -2, -4, -6, 0, -2, -4, -6};
+    const uint8x8_t msb_idx = vld1_u8(msb_tbl);
+    const uint8x8_t lsb_idx = vld1_u8(lsb_tbl);
+    const int16x8_t shift = vld1q_s16(lsb_shift);
+    const uint16x8_t mask = vdupq_n_u16(3);
+
+    for (; i + 16 <= pixels; i += 8) {
+        uint8x8x2_t v;
+        uint16x8_t hi, lo;
+
+        v.val[0] = vld1_u8(src + i / 4 * 5);
+        v.val[1] = vld1_u8(src + i / 4 * 5 + 8);
+        hi = vshll_n_u8(vtbl2_u8(v, msb_idx), 2);
+        lo = vmovl_u8(vtbl2_u8(v, lsb_idx));
+        lo = vandq_u16(vshlq_u16(lo, shift), mask);
+        vst1q_u16(dst + i, vorrq_u16(hi, lo));
+    }
+#endif
+
+    for (; i < pixels; i++) {
+        const guint8 *g = src + i / 4 * 5;
+        guint k = i % 4;
+
+        dst[i] = (g[k] << 2) | ((g[4] >> (k * 2)) & 0x3);
+    }
+}
+
+/*
+ * MIPI CSI-2 RAW12: 2 pixels in 3 bytes, bits 11:4 first, then one byte
+ * with the low nibbles (pixel 0 in the low nibble).
+ */
+void
+gst_sunxiv4l2_unpack_raw12(guint16 *dst, const guint8 *src, gsize pixels)
+{
+    gsize i = 0;
+
+#if defined(__SSE4_1__)
+    /* lane = msb << 8 | nibbles */
+    const __m128i idx = _mm_setr_epi8(2, 0, 2, 1, 5, 3, 5, 4, 8, 6, 8, 7, 11, 9, 11, 10);
+    const __m128i msb_mask = _mm_set1_epi16(0xff0);
+    const __m128i even = _mm_setr_epi16(0xf, 0, 0xf, 0, 0xf, 0, 0xf, 0);
+    const __m128i odd = _mm_setr_epi16(0, 0xf, 0, 0xf, 0, 0xf, 0, 0xf);
+
+    for (; i + 12 <= pixels; i += 8) {
+        __m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + i / 2 * 3)), idx);
+        __m128i s = _mm_srli_epi16(v, 4);
+        __m128i lo = _mm_or_si128(_mm_and_si128(v, even), _mm_and_si128(s, odd));
+
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(_mm_and_si128(s, msb_mask), lo));
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    const uint8x8_t nibble = vdup_n_u8(0xf);
+
+    for (; i + 16 <= pixels; i += 16) {
+        uint8x8x3_t v = vld3_u8(src + i / 2 * 3);
+        uint16x8x2_t p;
+
+        p.val[0] = vorrq_u16(vshll_n_u8(v.val[0], 4), vmovl_u8(vand_u8(v.val[2], nibble)));
+        p.val[1] = vorrq_u16(vshll_n_u8(v.val[1], 4), vmovl_u8(vshr_n_u8(v.val[2], 4)));
+        vst2q_u16(dst + i, p);
+    }
+#endif
+
+    for (; i < pixels; i++) {
+        const guint8 *g = src + i / 2 * 3;
+        guint k = i % 2;
+
+        dst[i] = (g[k] << 4) | ((g[2] >> (k * 4)) & 0xf);
+    }
+}
+
+/* vertical bilinear step: dst = a * (256 - weight) + b * weight, weight <= 256 */
+void
+gst_sunxiv4l2_blend_rows(guint16 *dst, const guint8 *a, const guint8 *b, guint weight, gsize n)
+{
+    guint wa = 256 - weight;
+    gsize i = 0;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i va = _mm_set1_epi16(wa);
+    const __m128i vb = _mm_set1_epi16(weight);
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(x, zero), va),
+                                   _mm_mullo_epi16(_mm_unpacklo_epi8(y, zero), vb));
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(x, zero), va),
+                                   _mm_mullo_epi16(_mm_unpackhi_epi8(y, zero), vb));
+
+        _mm_storeu_si128((__m128i *)(dst + i), lo);
+        _mm_storeu_si128((__m128i *)(dst + i + 8), hi);
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t x = vld1q_u8(a + i);
+        uint8x16_t y = vld1q_u8(b + i);
+
+        vst1q_u16(dst + i, vmlaq_n_u16(vmulq_n_u16(vmovl_u8(vget_low_u8(x)), wa),
+                                       vmovl_u8(vget_low_u8(y)), weight));
+        vst1q_u16(dst + i + 8, vmlaq_n_u16(vmulq_n_u16(vmovl_u8(vget_high_u8(x)), wa),
+                                           vmovl_u8(vget_high_u8(y)), weight));
+    }
+#endif
+
+    for (; i < n; i++)
+        dst[i] = a[i] * wa + b[i] * weight;
+}
+
+/* acc[i] += src[i], the vertical half of a box filter */
+void
+gst_sunxiv4l2_accumulate_row(guint16 *acc, const guint8 *src, gsize n)
+{
+    gsize i = 0;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i lo = _mm_loadu_si128((const __m128i *)(acc + i));
+        __m128i hi = _mm_loadu_si128((const __m128i *)(acc + i + 8));
+
+        _mm_storeu_si128((__m128i *)(acc + i), _mm_add_epi16(lo, _mm_unpacklo_epi8(x, zero)));
+        _mm_storeu_si128((__m128i *)(acc + i + 8), _mm_add_epi16(hi, _mm_unpackhi_epi8(x, zero)));
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t x = vld1q_u8(src + i);
+
+        vst1q_u16(acc + i, vaddw_u8(vld1q_u16(acc + i), vget_low_u8(x)));
+        vst1q_u16(acc + i + 8, vaddw_u8(vld1q_u16(acc + i + 8), vget_high_u8(x)));
+    }
+#endif
+
+    for (; i < n; i++)
+        acc[i] += src[i];
+}
+
+/*
+ * Sum and sum of squares of one luma row and, when prev is given, the SAD
+ * against it accumulated per 16 pixel column block into block_sad[].
+ */
+void
+gst_sunxiv4l2_luma_row_stats(const guint8 *row, const guint8 *prev, gsize n,
+                             guint64 *sum, guint64 *sumsq, guint32 *block_sad)
+{
+    guint64 s = 0, sq = 0;
+    gsize i = 0;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    __m128i vs = _mm_setzero_si128();
+    __m128i vsq = _mm_setzero_si128();
+    guint32 lanes[4];
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(row + i));
+        __m128i lo = _mm_unpacklo_epi8(x, zero);
+        __m128i hi = _mm_unpackhi_epi8(x, zero);
+
+        vs = _mm_add_epi64(vs, _mm_sad_epu8(x, zero));
+        vsq = _mm_add_epi32(vsq, _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi)));
+
+        if (prev) {
+            __m128i d = _mm_sad_epu8(x, _mm_loadu_si128((const __m128i *)(prev + i)));
+
+            block_sad[i / 16] += _mm_cvtsi128_si32(d) + _mm_cvtsi128_si32(_mm_srli_si128(d, 8));
+        }
+    }
+
+    s = (guint64)_mm_cvtsi128_si32(vs) + (guint64)_mm_cvtsi128_si32(_mm_srli_si128(vs, 8));
+    _mm_storeu_si128((__m128i *)lanes, vsq);
+    sq = (guint64)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    uint32x4_t vs = vdupq_n_u32(0);
+    uint32x4_t vsq = vdupq_n_u32(0);
+
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t x = vld1q_u8(row + i);
+
+        vs = vpadalq_u16(vs, vpaddlq_u8(x));
+        vsq = vpadalq_u16(vsq, vmull_u8(vget_low_u8(x), vget_low_u8(x)));
+        vsq = vpadalq_u16(vsq, vmull_u8(vget_high_u8(x), vget_high_u8(x)));
+
+        if (prev) {
+            uint64x2_t d = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(vabdq_u8(x, vld1q_u8(prev + i)))));
+
+            block_sad[i / 16] += vgetq_lane_u64(d, 0) + vgetq_lane_u64(d, 1);
+        }
+    }
+
+    s = (guint64)vgetq_lane_u32(vs, 0) + vgetq_lane_u32(vs, 1) + vgetq_lane_u32(vs, 2) + vgetq_lane_u32(vs, 3);
+    sq = (guint64)vgetq_lane_u32(vsq, 0) + vgetq_lane_u32(vsq, 1) + vgetq_lane_u32(vsq, 2) + vgetq_lane_u32(vsq, 3);
+#endif
+
+    for (; i < n; i++) {
+        s += row[i];
+        sq += row[i] * row[i];
+
+        if (prev)
+            block_sad[i / 16] += ABS(row[i] - prev[i]);
+    }
+
+    *sum += s;
+    *sumsq += sq;
+}
+
+/* dst = src with the order of its n elements of pstride (1 or 2) bytes reversed */
+void
+gst_sunxiv4l2_reverse_row(guint8 *dst, const guint8 *src, gsize n, guint pstride)
+{
+    gsize bytes = n * pstride;
+    gsize i = 0;
+
+#if defined(__SSE2__)
+    for (; i + 16 <= bytes; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(src + bytes - i - 16));
+
+        x = _mm_shuffle_epi32(x, _MM_SHUFFLE(0, 1, 2, 3));
+        x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+        x = _mm_shufflehi_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+
+        if (pstride == 1)
+            x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+
+        _mm_storeu_si128((__m128i *)(dst + i), x);
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; i + 16 <= bytes; i += 16) {
+        if (pstride == 1) {
+            uint8x16_t x = vrev64q_u8(vld1q_u8(src + bytes - i - 16));
+
+            vst1q_u8(dst + i, vcombine_u8(vget_high_u8(x), vget_low_u8(x)));
+        } else {
+            uint16x8_t x = vrev64q_u16(vld1q_u16((const uint16_t *)(src + bytes - i - 16)));
+
+            vst1q_u16((uint16_t *)(dst + i), vcombine_u16(vget_high_u16(x), vget_low_u16(x)));
+        }
+    }
+#endif
+
+    for (; i < bytes; i += pstride)
+        memcpy(dst + i, src + bytes - i - pstride, pstride);
+}
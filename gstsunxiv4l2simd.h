@@ -0,0 +1,17 @@
+#ifndef _GST_SUNXIV4L2_SIMD_H
+#define _GST_SUNXIV4L2_SIMD_H
+
+#include <glib.h>
+
+void gst_sunxiv4l2_stream_copy(gpointer dst, gconstpointer src, gsize size);
+void gst_sunxiv4l2_swap_uv(guint8 *dst, const guint8 *src, gsize pairs);
+void gst_sunxiv4l2_split_uv(guint8 *dst_a, guint8 *dst_b, const guint8 *src, gsize pairs);
+void gst_sunxiv4l2_unpack_raw10(guint16 *dst, const guint8 *src, gsize pixels);
+void gst_sunxiv4l2_unpack_raw12(guint16 *dst, const guint8 *src, gsize pixels);
+void gst_sunxiv4l2_accumulate_row(guint16 *acc, const guint8 *src, gsize n);
+void gst_sunxiv4l2_luma_row_stats(const guint8 *row, const guint8 *prev, gsize n,
+                                  guint64 *sum, guint64 *sumsq, guint32 *block_sad);
+void gst_sunxiv4l2_reverse_row(guint8 *dst, const guint8 *src, gsize n, guint pstride);
+void gst_sunxiv4l2_blend_rows(guint16 *dst, const guint8 *a, const guint8 *b, guint weight, gsize n);
+
+#endif
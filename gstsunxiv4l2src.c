@@ -1,9 +1,13 @@
 #ifdef HAVE_CONFIG_H
 #include <config.h>
 #endif
+#define _GNU_SOURCE
 #define _XOPEN_SOURCE 600
 #include <stdlib.h>
 #include <stdio.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
 #include <time.h>
 #include <unistd.h>
 #include <string.h>
@@ -15,6 +19,9 @@
 #include "gstsunxiv4l2.h"
 #include "gstsunxiv4l2src.h"
 #include "gstsunxiv4l2allocator.h"
+#include "gstsunxiv4l2simd.h"
+#include "gstsunxiv4l2convert.h"
+#include "gstsunxiv4l2meta.h"
 
 #define DEFAULT_DEVICE "/dev/video0"
 #define DEFAULT_WIDTH 320
@@ -23,6 +30,24 @@
 #define DEFAULT_NUMERATOR 30
 #define DEFAULT_FORMAT "NV21"
 #define DEFAULT_SIZE (src->info.width * src->info.height * 3 / 2)
+#define CAPTURE_POLL_TIMEOUT_MS 100
+/* stream restart backoff, doubled per failed attempt */
+#define RECOVERY_BACKOFF_US (10 * 1000)
+#define RECOVERY_BACKOFF_MAX_US (200 * 1000)
+/* corrupt frames in a row before the stream is restarted */
+#define RECOVERY_ERROR_FRAMES 8
+/* the source changed resolution or format, renegotiate */
+#define GST_SUNXI_V4L2SRC_FLOW_SOURCE_CHANGE GST_FLOW_CUSTOM_SUCCESS_1
+/* how long a source change waits for downstream to return old frames */
+#define SOURCE_CHANGE_RELEASE_TIMEOUT_US (2 * G_USEC_PER_SEC)
+#define SENSOR_CLOCK_BANDWIDTH 0.1  /* Hz, how fast the clock follows the sensor */
+#define LATENCY_WINDOW_FRAMES 64
+#define LATENCY_MIN_CHANGE (GST_MSECOND)
+#define SMOOTH_GAIN_SHIFT 4     /* 1/16 of the jitter goes into the smoothed pts */
+#define QOS_MAX_FACTOR 8
+#define QOS_OVERLOAD 1.2        /* smoothed proportion that drops more frames */
+#define QOS_RECOVER 0.9         /* load predicted at the lower factor that takes frames back */
+#define QOS_HOLD_US (2 * G_USEC_PER_SEC)
 
 enum
 {
@@ -30,19 +55,223 @@ enum
     PROP_DEVICE,
     PROP_IOMODE,
     PROP_CAMERA_INDEX,
+    PROP_KEEP_STREAMING,
+    PROP_STARVATION_THRESHOLD,
+    PROP_DROP_STALE,
+    PROP_DECIMATE,
+    PROP_MAX_FRAMERATE,
+    PROP_CPU_AFFINITY,
+    PROP_RT_PRIORITY,
+    PROP_RT_POLICY,
+    PROP_DEVICE_ONLY,
+    PROP_N_THREADS,
+    PROP_TENSOR_TYPE,
+    PROP_TENSOR_WIDTH,
+    PROP_TENSOR_HEIGHT,
+    PROP_TENSOR_MEAN,
+    PROP_TENSOR_SCALE,
+    PROP_PREVIEW_SCALE,
+    PROP_PREVIEW_INTERVAL,
+    PROP_LUMA_STATS,
+    PROP_LUMA_STATS_STEP,
+    PROP_STATIC_THRESHOLD,
+    PROP_STATIC_KEEPALIVE,
+    PROP_CROP_LEFT,
+    PROP_CROP_RIGHT,
+    PROP_CROP_TOP,
+    PROP_CROP_BOTTOM,
+    PROP_BATCH_MAX,
+    PROP_BATCH_LATENCY,
+    PROP_PROVIDE_CLOCK,
+    PROP_SMOOTH_TIMESTAMPS,
+    PROP_QOS_DECIMATE,
+    PROP_RECOVERY_ATTEMPTS,
+    PROP_WATCHDOG_TIMEOUT,
+    PROP_STATS,
+    PROP_VIDEO_DIRECTION,
 };
 
 GST_DEBUG_CATEGORY_STATIC(sunxiv4l2src_debug);
 #define GST_CAT_DEFAULT sunxiv4l2src_debug
 
+static void gst_sunxi_v4l2src_video_direction_init(GstVideoDirectionInterface *iface);
+
 #define gst_sunxi_v4l2src_parent_class parent_class
-G_DEFINE_TYPE(GstSunxiV4l2Src, gst_sunxi_v4l2src, GST_TYPE_PUSH_SRC);
+G_DEFINE_TYPE_WITH_CODE(GstSunxiV4l2Src, gst_sunxi_v4l2src, GST_TYPE_PUSH_SRC,
+    G_IMPLEMENT_INTERFACE(GST_TYPE_VIDEO_DIRECTION, gst_sunxi_v4l2src_video_direction_init));
+
+#define GST_TYPE_SUNXI_V4L2SRC_RT_POLICY (gst_sunxi_v4l2src_rt_policy_get_type())
+static GType
+gst_sunxi_v4l2src_rt_policy_get_type(void)
+{
+    static GType rt_policy_type = 0;
+    static const GEnumValue rt_policies[] = {
+        {GST_SUNXI_V4L2SRC_RT_POLICY_FIFO, "SCHED_FIFO", "fifo"},
+        {GST_SUNXI_V4L2SRC_RT_POLICY_RR, "SCHED_RR", "rr"},
+        {0, NULL, NULL},
+    };
+
+    if (!rt_policy_type)
+        rt_policy_type = g_enum_register_static("GstSunxiV4l2SrcRtPolicy", rt_policies);
+
+    return rt_policy_type;
+}
+
+static GstStructure *
+gst_sunxi_v4l2src_create_stats(GstSunxiV4l2Src *src)
+{
+    GstStructure *s;
+
+    GST_OBJECT_LOCK(src);
+    s = gst_structure_new("GstSunxiV4l2SrcStats",
+        "idle-recycled", G_TYPE_UINT64, src->idle_recycled,
+        "copied", G_TYPE_UINT64, src->copied,
+        "stale-dropped", G_TYPE_UINT64, src->stale_dropped,
+        "decimated", G_TYPE_UINT64, src->decimated,
+        "static-suppressed", G_TYPE_UINT64, src->static_suppressed,
+        "batches", G_TYPE_UINT64, src->batches,
+        "batched", G_TYPE_UINT64, src->batched,
+        "capture-latency", G_TYPE_UINT64, src->capture_latency,
+        "smooth-resyncs", G_TYPE_UINT64, src->smooth_resyncs,
+        "qos-decimated", G_TYPE_UINT64, src->qos_decimated,
+        "qos-factor", G_TYPE_INT, src->qos_factor,
+        "recoveries", G_TYPE_UINT64, src->recoveries,
+        "recovery-failures", G_TYPE_UINT64, src->recovery_failures,
+        "corrupt-frames", G_TYPE_UINT64, src->corrupt_frames,
+        "source-changes", G_TYPE_UINT64, src->source_changes,
+        "sched-latency-avg", G_TYPE_UINT64, src->sched_latency_avg,
+        "sched-latency-max", G_TYPE_UINT64, src->sched_latency_max,
+        NULL);
+    GST_OBJECT_UNLOCK(src);
+
+    return s;
+}
+
+#define GST_TYPE_SUNXI_V4L2SRC_TENSOR_TYPE (gst_sunxi_v4l2src_tensor_type_get_type())
+static GType
+gst_sunxi_v4l2src_tensor_type_get_type(void)
+{
+    static GType tensor_type = 0;
+    static const GEnumValue tensor_types[] = {
+        {GST_SUNXI_TENSOR_NONE, "video frames", "none"},
+        {GST_SUNXI_TENSOR_UINT8, "planar RGB uint8 tensor", "uint8"},
+        {GST_SUNXI_TENSOR_FLOAT32, "planar RGB float32 tensor", "float32"},
+        {0, NULL, NULL},
+    };
+
+    if (!tensor_type)
+        tensor_type = g_enum_register_static("GstSunxiV4l2SrcTensorType", tensor_types);
+
+    return tensor_type;
+}
+
+static void
+gst_sunxi_v4l2src_set_channels(gfloat *channels, const GValue *value)
+{
+    guint i, n = gst_value_array_get_size(value);
+
+    for (i = 0; i < 3 && i < n; i++)
+        channels[i] = g_value_get_float(gst_value_array_get_value(value, i));
+
+    /* a single value applies to every channel */
+    if (n == 1)
+        channels[1] = channels[2] = channels[0];
+}
+
+static void
+gst_sunxi_v4l2src_get_channels(const gfloat *channels, GValue *value)
+{
+    GValue v = G_VALUE_INIT;
+    guint i;
+
+    g_value_init(&v, G_TYPE_FLOAT);
+
+    for (i = 0; i < 3; i++) {
+        g_value_set_float(&v, channels[i]);
+        gst_value_array_append_value(value, &v);
+    }
+
+    g_value_unset(&v);
+}
+
+/* the interface is the video-direction property alone */
+static void
+gst_sunxi_v4l2src_video_direction_init(GstVideoDirectionInterface *iface)
+{
+}
+
+/*
+ * Flip with the sensor/VIN controls, V4L2_CID_ROTATE for 180 degrees if
+ * only that exists, and in software for whatever the device can't do.
+ * Called from the application thread too, the streaming thread reads the
+ * software flips under the object lock.
+ */
+static void
+gst_sunxi_v4l2src_apply_direction(GstSunxiV4l2Src *v4l2src)
+{
+    gboolean hflip = FALSE, vflip = FALSE, hw_hflip, hw_vflip;
+
+    switch (v4l2src->direction) {
+    case GST_VIDEO_ORIENTATION_IDENTITY:
+    case GST_VIDEO_ORIENTATION_AUTO:
+        break;
+    case GST_VIDEO_ORIENTATION_HORIZ:
+        hflip = TRUE;
+        break;
+    case GST_VIDEO_ORIENTATION_VERT:
+        vflip = TRUE;
+        break;
+    case GST_VIDEO_ORIENTATION_180:
+        hflip = vflip = TRUE;
+        break;
+    default:
+        GST_WARNING_OBJECT(v4l2src, "video-direction %d would change the frame size, ignored.",
+            v4l2src->direction);
+        break;
+    }
+
+    /* a flipped sensor reads out a different bayer order than the one
+     * negotiated and demosaiced, a software flip would do the same */
+    if ((hflip || vflip) && v4l2src->bayer) {
+        GST_WARNING_OBJECT(v4l2src, "flipping changes the bayer order of %s, video-direction ignored.",
+            GST_VIDEO_INFO_NAME(&v4l2src->out_info));
+        hflip = vflip = FALSE;
+    }
+
+    hw_hflip = gst_sunxiv4l2_set_ctrl(v4l2src->v4l2handle, V4L2_CID_HFLIP, hflip) == 0;
+    hw_vflip = gst_sunxiv4l2_set_ctrl(v4l2src->v4l2handle, V4L2_CID_VFLIP, vflip) == 0;
+
+    if (hflip && vflip && !hw_hflip && !hw_vflip)
+        hw_hflip = hw_vflip = gst_sunxiv4l2_set_ctrl(v4l2src->v4l2handle, V4L2_CID_ROTATE, 180) == 0;
+    else
+        gst_sunxiv4l2_set_ctrl(v4l2src->v4l2handle, V4L2_CID_ROTATE, 0);
+
+    hflip = hflip && !hw_hflip;
+    vflip = vflip && !hw_vflip;
+
+    if ((hflip || vflip) && (v4l2src->repack || v4l2src->sw_crop ||
+        !gst_sunxiv4l2_can_flip(GST_VIDEO_INFO_FORMAT(&v4l2src->info)))) {
+        GST_WARNING_OBJECT(v4l2src, "device can't flip and %s output can't be flipped in software.",
+            GST_VIDEO_INFO_NAME(&v4l2src->out_info));
+        hflip = vflip = FALSE;
+    }
+
+    if (hflip || vflip)
+        GST_INFO_OBJECT(v4l2src, "flipping%s%s in software", hflip ? " horizontally" : "",
+            vflip ? " vertically" : "");
+
+    GST_OBJECT_LOCK(v4l2src);
+    v4l2src->sw_hflip = hflip;
+    v4l2src->sw_vflip = vflip;
+    GST_OBJECT_UNLOCK(v4l2src);
+}
 
 static void
 gst_sunxiv4l2src_set_property(GObject *object, guint prop_id,
                               const GValue *value, GParamSpec *pspec)
 {
     GstSunxiV4l2Src *src = GST_SUNXI_V4L2SRC(object);
+    gboolean latency_changed;
     
     switch (prop_id)
     {
@@ -55,6 +284,126 @@ gst_sunxiv4l2src_set_property(GObject *object, guint prop_id,
     case PROP_CAMERA_INDEX:
         gst_sunxiv4l2_set_camera_index(src->v4l2handle, g_value_get_int(value));
         break;
+    case PROP_KEEP_STREAMING:
+        src->keep_streaming = g_value_get_boolean(value);
+        break;
+    case PROP_STARVATION_THRESHOLD:
+        src->starvation_threshold = g_value_get_uint(value);
+        break;
+    case PROP_DROP_STALE:
+        src->drop_stale = g_value_get_boolean(value);
+        break;
+    case PROP_DECIMATE:
+        src->decimate = g_value_get_uint(value);
+        break;
+    case PROP_MAX_FRAMERATE:
+        src->max_fps_n = gst_value_get_fraction_numerator(value);
+        src->max_fps_d = gst_value_get_fraction_denominator(value);
+        break;
+    case PROP_CPU_AFFINITY:
+        src->cpu_affinity = g_value_get_uint(value);
+        src->sched_thread = NULL;
+        break;
+    case PROP_RT_PRIORITY:
+        src->rt_priority = g_value_get_int(value);
+        src->sched_thread = NULL;
+        break;
+    case PROP_RT_POLICY:
+        src->rt_policy = g_value_get_enum(value);
+        src->sched_thread = NULL;
+        break;
+    case PROP_DEVICE_ONLY:
+        src->device_only = g_value_get_boolean(value);
+        break;
+    case PROP_N_THREADS:
+        src->n_threads = g_value_get_uint(value);
+        break;
+    case PROP_TENSOR_TYPE:
+        src->tensor.type = g_value_get_enum(value);
+        break;
+    case PROP_TENSOR_WIDTH:
+        src->tensor.width = g_value_get_uint(value);
+        break;
+    case PROP_TENSOR_HEIGHT:
+        src->tensor.height = g_value_get_uint(value);
+        break;
+    case PROP_TENSOR_MEAN:
+        gst_sunxi_v4l2src_set_channels(src->tensor.mean, value);
+        break;
+    case PROP_TENSOR_SCALE:
+        gst_sunxi_v4l2src_set_channels(src->tensor.scale, value);
+        break;
+    case PROP_PREVIEW_SCALE:
+        src->preview_scale = g_value_get_uint(value);
+        break;
+    case PROP_PREVIEW_INTERVAL:
+        src->preview_interval = g_value_get_uint(value);
+        break;
+    case PROP_LUMA_STATS:
+        src->luma_stats = g_value_get_boolean(value);
+        break;
+    case PROP_LUMA_STATS_STEP:
+        src->luma_step = g_value_get_uint(value);
+        break;
+    case PROP_STATIC_THRESHOLD:
+        src->static_threshold = g_value_get_uint(value);
+        break;
+    case PROP_STATIC_KEEPALIVE:
+        src->static_keepalive = g_value_get_uint(value);
+        break;
+    case PROP_CROP_LEFT:
+        src->crop_left = g_value_get_uint(value);
+        break;
+    case PROP_CROP_RIGHT:
+        src->crop_right = g_value_get_uint(value);
+        break;
+    case PROP_CROP_TOP:
+        src->crop_top = g_value_get_uint(value);
+        break;
+    case PROP_CROP_BOTTOM:
+        src->crop_bottom = g_value_get_uint(value);
+        break;
+    case PROP_BATCH_MAX:
+        /* batching adds batch-latency to what the latency query reports */
+        latency_changed = (src->batch_max > 1) != (g_value_get_uint(value) > 1);
+        src->batch_max = g_value_get_uint(value);
+        if (latency_changed)
+            gst_element_post_message(GST_ELEMENT_CAST(src),
+                gst_message_new_latency(GST_OBJECT_CAST(src)));
+        break;
+    case PROP_BATCH_LATENCY:
+        src->batch_latency = g_value_get_uint64(value);
+        break;
+    case PROP_PROVIDE_CLOCK:
+        GST_OBJECT_LOCK(src);
+        src->provide_clock = g_value_get_boolean(value);
+        if (src->provide_clock)
+            GST_OBJECT_FLAG_SET(src, GST_ELEMENT_FLAG_PROVIDE_CLOCK);
+        else
+            GST_OBJECT_FLAG_UNSET(src, GST_ELEMENT_FLAG_PROVIDE_CLOCK);
+        GST_OBJECT_UNLOCK(src);
+        break;
+    case PROP_SMOOTH_TIMESTAMPS:
+        src->smooth_timestamps = g_value_get_boolean(value);
+        src->smooth_valid = FALSE;
+        break;
+    case PROP_QOS_DECIMATE:
+        src->qos_decimate = g_value_get_boolean(value);
+        if (!src->qos_decimate)
+            g_atomic_int_set(&src->qos_factor, 1);
+        break;
+    case PROP_RECOVERY_ATTEMPTS:
+        src->recovery_attempts = g_value_get_uint(value);
+        break;
+    case PROP_WATCHDOG_TIMEOUT:
+        src->watchdog_timeout = g_value_get_uint(value);
+        break;
+    case PROP_VIDEO_DIRECTION:
+        src->direction = g_value_get_enum(value);
+        /* controls apply right away, otherwise at stream on */
+        if (src->stream_on)
+            gst_sunxi_v4l2src_apply_direction(src);
+        break;
     default:
         break;
     }
@@ -77,6 +426,108 @@ gst_sunxiv4l2src_get_property(GObject *object, guint prop_id,
     case PROP_CAMERA_INDEX:
         g_value_set_int(value, gst_sunxiv4l2_get_camera_index(src->v4l2handle));
         break;
+    case PROP_KEEP_STREAMING:
+        g_value_set_boolean(value, src->keep_streaming);
+        break;
+    case PROP_STARVATION_THRESHOLD:
+        g_value_set_uint(value, src->starvation_threshold);
+        break;
+    case PROP_DROP_STALE:
+        g_value_set_boolean(value, src->drop_stale);
+        break;
+    case PROP_DECIMATE:
+        g_value_set_uint(value, src->decimate);
+        break;
+    case PROP_MAX_FRAMERATE:
+        gst_value_set_fraction(value, src->max_fps_n, src->max_fps_d);
+        break;
+    case PROP_CPU_AFFINITY:
+        g_value_set_uint(value, src->cpu_affinity);
+        break;
+    case PROP_RT_PRIORITY:
+        g_value_set_int(value, src->rt_priority);
+        break;
+    case PROP_RT_POLICY:
+        g_value_set_enum(value, src->rt_policy);
+        break;
+    case PROP_DEVICE_ONLY:
+        g_value_set_boolean(value, src->device_only);
+        break;
+    case PROP_N_THREADS:
+        g_value_set_uint(value, src->n_threads);
+        break;
+    case PROP_TENSOR_TYPE:
+        g_value_set_enum(value, src->tensor.type);
+        break;
+    case PROP_TENSOR_WIDTH:
+        g_value_set_uint(value, src->tensor.width);
+        break;
+    case PROP_TENSOR_HEIGHT:
+        g_value_set_uint(value, src->tensor.height);
+        break;
+    case PROP_TENSOR_MEAN:
+        gst_sunxi_v4l2src_get_channels(src->tensor.mean, value);
+        break;
+    case PROP_TENSOR_SCALE:
+        gst_sunxi_v4l2src_get_channels(src->tensor.scale, value);
+        break;
+    case PROP_PREVIEW_SCALE:
+        g_value_set_uint(value, src->preview_scale);
+        break;
+    case PROP_PREVIEW_INTERVAL:
+        g_value_set_uint(value, src->preview_interval);
+        break;
+    case PROP_LUMA_STATS:
+        g_value_set_boolean(value, src->luma_stats);
+        break;
+    case PROP_LUMA_STATS_STEP:
+        g_value_set_uint(value, src->luma_step);
+        break;
+    case PROP_STATIC_THRESHOLD:
+        g_value_set_uint(value, src->static_threshold);
+        break;
+    case PROP_STATIC_KEEPALIVE:
+        g_value_set_uint(value, src->static_keepalive);
+        break;
+    case PROP_CROP_LEFT:
+        g_value_set_uint(value, src->crop_left);
+        break;
+    case PROP_CROP_RIGHT:
+        g_value_set_uint(value, src->crop_right);
+        break;
+    case PROP_CROP_TOP:
+        g_value_set_uint(value, src->crop_top);
+        break;
+    case PROP_CROP_BOTTOM:
+        g_value_set_uint(value, src->crop_bottom);
+        break;
+    case PROP_BATCH_MAX:
+        g_value_set_uint(value, src->batch_max);
+        break;
+    case PROP_BATCH_LATENCY:
+        g_value_set_uint64(value, src->batch_latency);
+        break;
+    case PROP_PROVIDE_CLOCK:
+        g_value_set_boolean(value, src->provide_clock);
+        break;
+    case PROP_SMOOTH_TIMESTAMPS:
+        g_value_set_boolean(value, src->smooth_timestamps);
+        break;
+    case PROP_QOS_DECIMATE:
+        g_value_set_boolean(value, src->qos_decimate);
+        break;
+    case PROP_RECOVERY_ATTEMPTS:
+        g_value_set_uint(value, src->recovery_attempts);
+        break;
+    case PROP_WATCHDOG_TIMEOUT:
+        g_value_set_uint(value, src->watchdog_timeout);
+        break;
+    case PROP_VIDEO_DIRECTION:
+        g_value_set_enum(value, src->direction);
+        break;
+    case PROP_STATS:
+        g_value_take_boxed(value, gst_sunxi_v4l2src_create_stats(src));
+        break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
         break;
@@ -110,239 +561,1935 @@ gst_sunxi_v4l2src_get_device_caps(GstBaseSrc *src)
     return caps;
 }
 
-static gboolean
-gst_sunxiv4l2src_set_caps(GstBaseSrc *bsrc, GstCaps *caps)
+static guint
+gst_sunxi_v4l2src_decimation(GstSunxiV4l2Src *v4l2src, gint fps_n, gint fps_d)
 {
-    const GstStructure *structure;
-    GstSunxiV4l2Src *v4l2src;
-    GstVideoInfo info;
-    gint v4l2_fmt;
+    guint factor = MAX(v4l2src->decimate, 1);
 
-    v4l2src = GST_SUNXI_V4L2SRC(bsrc);
-
-    GST_DEBUG("caps:%"GST_PTR_FORMAT, caps);
+    if (v4l2src->max_fps_n > 0 && fps_n > 0 && fps_d > 0) {
+        /* smallest factor that brings the sensor rate under max-framerate */
+        guint64 num = (guint64)fps_n * v4l2src->max_fps_d;
+        guint64 den = (guint64)fps_d * v4l2src->max_fps_n;
 
-    if (v4l2src->old_caps) {
-        if (gst_caps_is_equal(v4l2src->old_caps, caps))
-            return TRUE;
+        factor = MAX(factor, (guint)((num + den - 1) / den));
     }
 
-    if (gst_sunxi_video_info_from_caps(&info, caps)) {
-        GST_ERROR("invalid caps. %"GST_PTR_FORMAT, caps);
-        return FALSE;
-    }
+    return factor;
+}
 
-    v4l2_fmt = gst_sunxiv_v4l2_fmt_gst2v4l2(GST_VIDEO_INFO_FORMAT(&info));
+static GstCaps *
+gst_sunxi_v4l2src_decimate_caps(GstSunxiV4l2Src *v4l2src, GstCaps *caps)
+{
+    guint i, factor;
+    gint fps_n, fps_d;
 
-    if (!v4l2_fmt) {
-        GST_ERROR_OBJECT(v4l2src, "%s not supported", GST_VIDEO_INFO_NAME(&info));
-        return FALSE;
-    }
+    if (v4l2src->decimate <= 1 && v4l2src->max_fps_n <= 0)
+        return caps;
 
-    GST_DEBUG("[%c%c%c%c]", v4l2_fmt & 0xff, (v4l2_fmt >> 8) & 0xff, 
-                (v4l2_fmt >> 16) & 0xff, (v4l2_fmt >> 24) & 0xff);
-    GstVideoFormat gst_fmt = gst_video_format_from_fourcc(v4l2_fmt);
+    caps = gst_caps_make_writable(caps);
 
-    v4l2src->v4l2fmt = v4l2_fmt;
+    for (i = 0; i < gst_caps_get_size(caps); i++) {
+        GstStructure *structure = gst_caps_get_structure(caps, i);
 
-    memcpy(&v4l2src->info, &info, sizeof(info));
+        if (!gst_structure_get_fraction(structure, "framerate", &fps_n, &fps_d) || fps_n <= 0)
+            continue;
 
-    /* FIXME Add device reset*/
+        factor = gst_sunxi_v4l2src_decimation(v4l2src, fps_n, fps_d);
 
-    if (v4l2src->old_caps) {
-        gst_caps_unref(v4l2src->old_caps);
-        v4l2src->old_caps = NULL;
+        if (factor > 1 && gst_util_fraction_multiply(fps_n, fps_d, 1, factor, &fps_n, &fps_d))
+            gst_structure_set(structure, "framerate", GST_TYPE_FRACTION, fps_n, fps_d, NULL);
     }
 
-    v4l2src->old_caps = gst_caps_copy(caps);
-
-    return TRUE;
+    return caps;
 }
 
-static GstCaps *
-gst_sunxiv4l2src_fixate(GstBaseSrc *bsrc, GstCaps *caps)
+/* map the advertised (decimated) framerate back to the sensor framerate */
+static guint
+gst_sunxi_v4l2src_sensor_rate(GstSunxiV4l2Src *v4l2src, GstCaps *caps, GstVideoInfo *info)
 {
-    caps = GST_BASE_SRC_CLASS(parent_class)->fixate(bsrc, caps);
+    const GstStructure *structure = gst_caps_get_structure(caps, 0);
+    const gchar *format = gst_structure_get_string(structure, "format");
+    guint i, factor;
+    gint fps_n, fps_d, w, h;
 
-    return caps;
-}
+    if (v4l2src->decimate <= 1 && v4l2src->max_fps_n <= 0)
+        return 1;
 
-static GstCaps *
-gst_sunxiv4l2src_get_caps(GstBaseSrc *bsrc, GstCaps *filter)
-{
-    GstCaps *caps = NULL;
+    for (i = 0; v4l2src->probed_caps && i < gst_caps_get_size(v4l2src->probed_caps); i++) {
+        const GstStructure *probed = gst_caps_get_structure(v4l2src->probed_caps, i);
 
-    caps = gst_sunxi_v4l2src_get_device_caps(bsrc);
+        if (g_strcmp0(format, gst_structure_get_string(probed, "format")) ||
+            !gst_structure_get_int(probed, "width", &w) || w != info->width ||
+            !gst_structure_get_int(probed, "height", &h) || h != info->height ||
+            !gst_structure_get_fraction(probed, "framerate", &fps_n, &fps_d) || fps_n <= 0)
+            continue;
 
-    if (caps && filter)
-    {
-        GstCaps *intersection;
+        factor = gst_sunxi_v4l2src_decimation(v4l2src, fps_n, fps_d);
 
-        intersection = gst_caps_intersect_full(filter, caps, GST_CAPS_INTERSECT_FIRST);
-        gst_caps_unref(caps);
-        caps = intersection;
+        if (gst_util_fraction_compare(fps_n, fps_d * factor, info->fps_n, info->fps_d) == 0) {
+            info->fps_n = fps_n;
+            info->fps_d = fps_d;
+            return factor;
+        }
     }
 
-    return caps;
+    factor = MAX(v4l2src->decimate, 1);
+    info->fps_n *= factor;
+
+    return factor;
 }
 
 static gboolean
-gst_sunxiv4l2src_query(GstBaseSrc *bsrc, GstQuery *query)
+gst_sunxi_v4l2src_probed_has(GstSunxiV4l2Src *v4l2src, const gchar *format, gint width, gint height)
 {
-    GstSunxiV4l2Src *src;
-    gboolean ret = FALSE;
+    guint i;
+    gint w, h;
 
-    src = GST_SUNXI_V4L2SRC(bsrc);
+    for (i = 0; i < gst_caps_get_size(v4l2src->probed_caps); i++) {
+        const GstStructure *probed = gst_caps_get_structure(v4l2src->probed_caps, i);
 
-    switch(GST_QUERY_TYPE(query)) {
-        case GST_QUERY_LATENCY: {
-            GstClockTime min_latency, max_latency;
-            guint32 fps_n, fps_d;
-            guint num_buffers = 0;
-            GstStructure *config;
-            if (!gst_sunxiv4l2_is_open(src->v4l2handle)) {
-                GST_WARNING("Can't give latency since device isn't open!");
-                goto done;
-            }
+        if (!g_strcmp0(format, gst_structure_get_string(probed, "format")) &&
+            gst_structure_get_int(probed, "width", &w) && w == width &&
+            gst_structure_get_int(probed, "height", &h) && h == height)
+            return TRUE;
+    }
 
-            fps_n = gst_sunxiv4l2_fps_n(src->v4l2handle);
-            fps_d = gst_sunxiv4l2_fps_d(src->v4l2handle);
+    return FALSE;
+}
 
-            if (fps_n <= 0 || fps_d <= 0) {
-                GST_WARNING("Can't give latency since framerate isn't fixated !");
-                goto done;
-            }
+/*
+ * advertise NV12/NV21/I420 next to every semi-planar format the VIN gives,
+ * and NV12 next to raw bayer (demosaiced in software)
+ */
+static GstCaps *
+gst_sunxi_v4l2src_derive_caps(GstCaps *caps)
+{
+    static const gchar *derived[] = {"NV12", "NV21", "I420"};
+    GstCaps *extra = gst_caps_new_empty();
+    guint i, j;
 
-            min_latency = gst_util_uint64_scale_int(GST_SECOND, fps_d, fps_n);
+    for (i = 0; i < gst_caps_get_size(caps); i++) {
+        const GstStructure *structure = gst_caps_get_structure(caps, i);
+        const gchar *format = gst_structure_get_string(structure, "format");
 
-            if (src->pool != NULL) {
-                config = gst_buffer_pool_get_config(src->pool);
-                gst_buffer_pool_config_get_params(config, NULL, NULL, NULL, &num_buffers);
-            }
+        if (gst_structure_has_name(structure, "video/x-bayer")) {
+            GstStructure *s = gst_structure_copy(structure);
 
-            if (num_buffers == 0)
-                max_latency = -1;
-            else
-                max_latency = num_buffers * min_latency;
+            gst_structure_set_name(s, "video/x-raw");
+            gst_structure_set(s, "format", G_TYPE_STRING, "NV12", NULL);
+            gst_caps_append_structure(extra, s);
+            continue;
+        }
 
-            GST_DEBUG("report latency min %" GST_TIME_FORMAT " max %" GST_TIME_FORMAT,
-                GST_TIME_ARGS(min_latency), GST_TIME_ARGS(max_latency));
+        if (g_strcmp0(format, "NV12") && g_strcmp0(format, "NV21"))
+            continue;
 
-            gst_query_set_latency(query, TRUE, min_latency, max_latency);
+        for (j = 0; j < G_N_ELEMENTS(derived); j++) {
+            GstStructure *s;
 
-            ret = TRUE;                
+            if (!g_strcmp0(format, derived[j]))
+                continue;
+
+            s = gst_structure_copy(structure);
+            gst_structure_set(s, "format", G_TYPE_STRING, derived[j], NULL);
+            gst_caps_append_structure(extra, s);
         }
-        break;
-        default:
-            ret = GST_BASE_SRC_CLASS(parent_class)->query(bsrc, query);
-            break;
     }
 
-done:
-    return ret;
+    /* native formats first, they stay zero-copy */
+    return gst_caps_merge(caps, extra);
 }
 
-static gint
-gst_sunxi_v4l2src_config(GstSunxiV4l2Src *v4l2src)
+/* caps to program into the VIN for the negotiated (maybe derived) caps */
+static GstCaps *
+gst_sunxi_v4l2src_capture_caps(GstSunxiV4l2Src *v4l2src, GstCaps *caps)
 {
-    guint w, h;
+    static const gchar *natives[] = {"NV21", "NV12"};
+    const GstStructure *structure = gst_caps_get_structure(caps, 0);
+    const gchar *format = gst_structure_get_string(structure, "format");
+    gint width = 0, height = 0, w, h;
+    GstCaps *capture;
+    guint i;
+
+    gst_structure_get_int(structure, "width", &width);
+    gst_structure_get_int(structure, "height", &height);
+
+    if (!v4l2src->probed_caps || !format ||
+        gst_sunxi_v4l2src_probed_has(v4l2src, format, width, height))
+        return gst_caps_ref(caps);
+
+    for (i = 0; i < G_N_ELEMENTS(natives); i++) {
+        if (!gst_sunxi_v4l2src_probed_has(v4l2src, natives[i], width, height) ||
+            !gst_sunxiv4l2_can_repack(gst_video_format_from_string(natives[i]),
+                                      gst_video_format_from_string(format)))
+            continue;
+
+        capture = gst_caps_copy(caps);
+        gst_caps_set_simple(capture, "format", G_TYPE_STRING, natives[i], NULL);
+
+        return capture;
+    }
 
-    w = v4l2src->info.width + v4l2src->video_align.padding_left + v4l2src->video_align.padding_right;
-    h = v4l2src->info.height + v4l2src->video_align.padding_top + v4l2src->video_align.padding_bottom;
+    if (g_strcmp0(format, "NV12"))
+        return gst_caps_ref(caps);
 
-    GST_DEBUG("%d * %d pading: (%d, %d), (%d, %d) fps:%d/%d",
-        w,h,
-        v4l2src->video_align.padding_left, v4l2src->video_align.padding_top,
-        v4l2src->video_align.padding_right, v4l2src->video_align.padding_bottom,
-        v4l2src->info.fps_n, v4l2src->info.fps_d);
+    /* no ISP in the path, demosaic whatever the sensor gives */
+    for (i = 0; i < gst_caps_get_size(v4l2src->probed_caps); i++) {
+        const GstStructure *probed = gst_caps_get_structure(v4l2src->probed_caps, i);
+        GstStructure *s;
 
-    return gst_sunxi_v4l2capture_config(v4l2src->v4l2handle, v4l2src->v4l2fmt, w, h, v4l2src->info.fps_n, v4l2src->info.fps_d);
+        if (!gst_structure_has_name(probed, "video/x-bayer") ||
+            !gst_structure_get_int(probed, "width", &w) || w != width ||
+            !gst_structure_get_int(probed, "height", &h) || h != height)
+            continue;
+
+        capture = gst_caps_copy(caps);
+        s = gst_caps_get_structure(capture, 0);
+        gst_structure_set_name(s, "video/x-bayer");
+        gst_structure_set(s, "format", G_TYPE_STRING, gst_structure_get_string(probed, "format"), NULL);
+        gst_structure_remove_fields(s, "colorimetry", "chroma-site", NULL);
+
+        return capture;
+    }
+
+    return gst_caps_ref(caps);
 }
 
-static gint
-gst_sunxi_v4l2_callocator_cb(gpointer user_data, gint *buffer_count)
+/* the negotiated size is the crop window, the VIN still runs the full mode */
+static GstCaps *
+gst_sunxi_v4l2src_crop_caps(GstSunxiV4l2Src *v4l2src, GstCaps *caps)
 {
-    GstSunxiV4l2Src *v4l2src = GST_SUNXI_V4L2SRC(user_data);
-    gint ret;
-    guint min, max;
-
-    if (!v4l2src->pool)
-        v4l2src->pool = gst_base_src_get_buffer_pool(GST_BASE_SRC(v4l2src));
-    if (v4l2src->pool) {
-        GstStructure *config;
-        config = gst_buffer_pool_get_config(v4l2src->pool);
+    gint dw = v4l2src->crop_left + v4l2src->crop_right;
+    gint dh = v4l2src->crop_top + v4l2src->crop_bottom;
+    gint w, h;
+    guint i;
 
-        memset(&v4l2src->video_align, 0, sizeof(GstVideoAlignment));
-        if (gst_buffer_pool_config_has_option(config, GST_BUFFER_POOL_OPTION_VIDEO_ALIGNMENT)) {
-            gst_buffer_pool_config_get_video_alignment(config, &v4l2src->video_align);
-            GST_DEBUG("pool has alignment (%d, %d), (%d, %d)",
-                v4l2src->video_align.padding_left, v4l2src->video_align.padding_top,
-                v4l2src->video_align.padding_right, v4l2src->video_align.padding_bottom);
-        }
+    if (!dw && !dh)
+        return caps;
 
-        gst_buffer_pool_config_get_params(config, NULL, NULL, &min, &max);
-        GST_DEBUG("need allocated %d buffers.", max);
+    caps = gst_caps_make_writable(caps);
 
-        gst_structure_free(config);
+    for (i = gst_caps_get_size(caps); i-- > 0;) {
+        GstStructure *structure = gst_caps_get_structure(caps, i);
 
-        if (gst_sunxi_v4l2src_config(v4l2src) < 0) {
-            GST_ERROR_OBJECT(v4l2src, "camera configuration failed.");
-            g_print("capture device: %s probed caps: %"GST_PTR_FORMAT, v4l2src->device, v4l2src->probed_caps);
-            g_print("Please config accepted caps!\n");
-            return -1;
+        if (!gst_structure_get_int(structure, "width", &w) || w <= dw ||
+            !gst_structure_get_int(structure, "height", &h) || h <= dh) {
+            gst_caps_remove_structure(caps, i);
+            continue;
+        }
+
+        gst_structure_set(structure, "width", G_TYPE_INT, w - dw, "height", G_TYPE_INT, h - dh, NULL);
+    }
+
+    return caps;
+}
+
+static GstCaps *
+gst_sunxi_v4l2src_uncrop_caps(GstSunxiV4l2Src *v4l2src, GstCaps *caps)
+{
+    gint dw = v4l2src->crop_left + v4l2src->crop_right;
+    gint dh = v4l2src->crop_top + v4l2src->crop_bottom;
+    gint w = 0, h = 0;
+
+    if (!dw && !dh)
+        return gst_caps_ref(caps);
+
+    gst_structure_get_int(gst_caps_get_structure(caps, 0), "width", &w);
+    gst_structure_get_int(gst_caps_get_structure(caps, 0), "height", &h);
+
+    caps = gst_caps_copy(caps);
+    gst_caps_set_simple(caps, "width", G_TYPE_INT, w + dw, "height", G_TYPE_INT, h + dh, NULL);
+
+    return caps;
+}
+
+/* preview geometry follows the capture, called whenever that changes */
+static void
+gst_sunxi_v4l2src_preview_setup(GstSunxiV4l2Src *v4l2src)
+{
+    GstVideoFormat format = GST_VIDEO_INFO_FORMAT(&v4l2src->info);
+    guint scale = v4l2src->preview_scale;
+    guint width = (GST_VIDEO_INFO_WIDTH(&v4l2src->info) / scale) & ~1;
+    guint height = (GST_VIDEO_INFO_HEIGHT(&v4l2src->info) / scale) & ~1;
+
+    gst_video_info_init(&v4l2src->preview_info);
+
+    if (v4l2src->preview_pool) {
+        gst_buffer_pool_set_active(v4l2src->preview_pool, FALSE);
+        gst_object_unref(v4l2src->preview_pool);
+        v4l2src->preview_pool = NULL;
+    }
+
+    v4l2src->preview_need_events = TRUE;
+    v4l2src->preview_phase = 0;
+
+    if (v4l2src->bayer || !width || !height ||
+        (format != GST_VIDEO_FORMAT_NV12 && format != GST_VIDEO_FORMAT_NV21)) {
+        GST_DEBUG_OBJECT(v4l2src, "no preview for %s %dx%d", GST_VIDEO_INFO_NAME(&v4l2src->info),
+            GST_VIDEO_INFO_WIDTH(&v4l2src->info), GST_VIDEO_INFO_HEIGHT(&v4l2src->info));
+        return;
+    }
+
+    gst_video_info_set_format(&v4l2src->preview_info, format, width, height);
+
+    if (v4l2src->info.fps_n > 0)
+        gst_util_fraction_multiply(v4l2src->info.fps_n, v4l2src->info.fps_d,
+            1, MAX(v4l2src->decimation, 1) * v4l2src->preview_interval,
+            &v4l2src->preview_info.fps_n, &v4l2src->preview_info.fps_d);
+}
+
+static GstStructure *
+gst_sunxi_v4l2src_tensor_structure(GstSunxiV4l2Src *v4l2src)
+{
+    GstStructure *structure;
+    gchar *dimensions;
+
+    /* innermost dimension first: planar RGB is width:height:channel */
+    dimensions = g_strdup_printf("%u:%u:3:1", v4l2src->tensor.width, v4l2src->tensor.height);
+    structure = gst_structure_new("other/tensors",
+        "format", G_TYPE_STRING, "static",
+        "num_tensors", G_TYPE_INT, 1,
+        "dimensions", G_TYPE_STRING, dimensions,
+        "types", G_TYPE_STRING, v4l2src->tensor.type == GST_SUNXI_TENSOR_FLOAT32 ? "float32" : "uint8",
+        NULL);
+    g_free(dimensions);
+
+    return structure;
+}
+
+/* one tensor structure per frame rate the semi-planar formats run at */
+static GstCaps *
+gst_sunxi_v4l2src_tensor_caps(GstSunxiV4l2Src *v4l2src, GstCaps *caps)
+{
+    GstCaps *tensor = gst_caps_new_empty();
+    guint i;
+
+    for (i = 0; i < gst_caps_get_size(caps); i++) {
+        const GstStructure *structure = gst_caps_get_structure(caps, i);
+        const gchar *format = gst_structure_get_string(structure, "format");
+        GstStructure *s;
+
+        if (!gst_structure_has_name(structure, "video/x-raw") ||
+            (g_strcmp0(format, "NV12") && g_strcmp0(format, "NV21")))
+            continue;
+
+        s = gst_sunxi_v4l2src_tensor_structure(v4l2src);
+        if (gst_structure_has_field(structure, "framerate"))
+            gst_structure_set_value(s, "framerate", gst_structure_get_value(structure, "framerate"));
+        tensor = gst_caps_merge_structure(tensor, s);
+    }
+
+    gst_caps_unref(caps);
+
+    return tensor;
+}
+
+/*
+ * Smallest NV12/NV21 capture at least as large as the tensor and able to
+ * deliver the negotiated rate, the largest one if none is big enough.
+ */
+static GstCaps *
+gst_sunxi_v4l2src_tensor_capture_caps(GstSunxiV4l2Src *v4l2src, GstCaps *caps)
+{
+    const GstStructure *structure = gst_caps_get_structure(caps, 0);
+    const GstStructure *best = NULL;
+    gint fps_n = 0, fps_d = 1, w, h, n, d;
+    guint64 best_area = 0;
+    gboolean best_fits = FALSE;
+    GstCaps *capture;
+    guint i;
+
+    gst_structure_get_fraction(structure, "framerate", &fps_n, &fps_d);
+
+    for (i = 0; v4l2src->probed_caps && i < gst_caps_get_size(v4l2src->probed_caps); i++) {
+        const GstStructure *probed = gst_caps_get_structure(v4l2src->probed_caps, i);
+        const gchar *format = gst_structure_get_string(probed, "format");
+        gboolean fits;
+        guint64 area;
+
+        if ((g_strcmp0(format, "NV12") && g_strcmp0(format, "NV21")) ||
+            !gst_structure_get_int(probed, "width", &w) ||
+            !gst_structure_get_int(probed, "height", &h))
+            continue;
+
+        if (fps_n > 0 && gst_structure_get_fraction(probed, "framerate", &n, &d) &&
+            gst_util_fraction_compare(n, d * gst_sunxi_v4l2src_decimation(v4l2src, n, d), fps_n, fps_d))
+            continue;
+
+        fits = (guint)w >= v4l2src->tensor.width && (guint)h >= v4l2src->tensor.height;
+        area = (guint64)w * h;
+
+        if (!best || (fits && (!best_fits || area < best_area)) || (!fits && !best_fits && area > best_area)) {
+            best = probed;
+            best_area = area;
+            best_fits = fits;
+        }
+    }
+
+    if (!best)
+        return NULL;
+
+    capture = gst_caps_new_empty();
+    gst_caps_append_structure(capture, gst_structure_copy(best));
+
+    if (fps_n > 0)
+        gst_caps_set_simple(capture, "framerate", GST_TYPE_FRACTION, fps_n, fps_d, NULL);
+
+    return capture;
+}
+
+static gboolean
+gst_sunxiv4l2src_set_caps(GstBaseSrc *bsrc, GstCaps *caps)
+{
+    const GstStructure *structure;
+    GstSunxiV4l2Src *v4l2src;
+    GstVideoInfo info, out_info;
+    GstCaps *capture_caps, *full_caps;
+    GstSunxiPlaneLayout layout;
+    GstVideoInfo try_info;
+    gint v4l2_fmt;
+
+    v4l2src = GST_SUNXI_V4L2SRC(bsrc);
+
+    GST_DEBUG("caps:%"GST_PTR_FORMAT, caps);
+
+    if (v4l2src->old_caps) {
+        if (gst_caps_is_equal(v4l2src->old_caps, caps))
+            return TRUE;
+    }
+
+    structure = gst_caps_get_structure(caps, 0);
+    v4l2src->tensor_out = gst_structure_has_name(structure, "other/tensors");
+    v4l2src->video_meta = gst_structure_has_name(structure, "video/x-raw");
+
+    if (v4l2src->tensor_out) {
+        capture_caps = gst_sunxi_v4l2src_tensor_capture_caps(v4l2src, caps);
+
+        if (!capture_caps) {
+            GST_ERROR_OBJECT(v4l2src, "no NV12/NV21 capture for %"GST_PTR_FORMAT, caps);
+            return FALSE;
+        }
+    } else {
+        if (gst_sunxi_video_info_from_caps(&out_info, caps)) {
+            GST_ERROR("invalid caps. %"GST_PTR_FORMAT, caps);
+            return FALSE;
+        }
+
+        full_caps = gst_sunxi_v4l2src_uncrop_caps(v4l2src, caps);
+        capture_caps = gst_sunxi_v4l2src_capture_caps(v4l2src, full_caps);
+        gst_caps_unref(full_caps);
+    }
+
+    if (gst_sunxi_video_info_from_caps(&info, capture_caps)) {
+        GST_ERROR("invalid capture caps. %"GST_PTR_FORMAT, capture_caps);
+        gst_caps_unref(capture_caps);
+        return FALSE;
+    }
+
+    v4l2src->sensor_width = info.width;
+    v4l2src->sensor_height = info.height;
+    v4l2src->hw_crop = FALSE;
+    v4l2src->sw_crop = FALSE;
+
+    if (!v4l2src->tensor_out && (info.width != out_info.width || info.height != out_info.height)) {
+        /* even offsets keep subsampled chroma on the same pixels */
+        v4l2src->crop.left = v4l2src->crop_left & ~1;
+        v4l2src->crop.top = v4l2src->crop_top & ~1;
+        v4l2src->crop.width = out_info.width;
+        v4l2src->crop.height = out_info.height;
+
+        if (gst_sunxiv4l2_crop_supported(v4l2src->v4l2handle)) {
+            full_caps = gst_caps_copy(capture_caps);
+            gst_caps_set_simple(full_caps, "width", G_TYPE_INT, out_info.width,
+                "height", G_TYPE_INT, out_info.height, NULL);
+
+            if (gst_sunxi_video_info_from_caps(&info, full_caps)) {
+                GST_ERROR("invalid crop caps. %"GST_PTR_FORMAT, full_caps);
+                gst_caps_unref(full_caps);
+                gst_caps_unref(capture_caps);
+                return FALSE;
+            }
+
+            gst_caps_unref(full_caps);
+            v4l2src->hw_crop = TRUE;
+        } else {
+            v4l2src->sw_crop = TRUE;
+        }
+
+        GST_INFO_OBJECT(v4l2src, "crop %ux%u at (%d, %d) in %s", v4l2src->crop.width, v4l2src->crop.height,
+            v4l2src->crop.left, v4l2src->crop.top, v4l2src->hw_crop ? "the VIN" : "meta");
+    }
+
+    if (v4l2src->tensor_out) {
+        /* only the size matters downstream of the tensor kernel */
+        memcpy(&out_info, &info, sizeof(info));
+        out_info.width = v4l2src->tensor.width;
+        out_info.height = v4l2src->tensor.height;
+        out_info.size = gst_sunxiv4l2_tensor_size(&v4l2src->tensor);
+    }
+
+    structure = gst_caps_get_structure(capture_caps, 0);
+    v4l2src->bayer = gst_structure_has_name(structure, "video/x-bayer");
+
+    if (v4l2src->bayer) {
+        const gchar *format = gst_structure_get_string(structure, "format");
+
+        if (!gst_sunxiv4l2_bayer_format(v4l2src->v4l2handle, format, &v4l2src->bayer_fmt)) {
+            GST_ERROR_OBJECT(v4l2src, "bayer %s not supported", format);
+            gst_caps_unref(capture_caps);
+            return FALSE;
+        }
+
+        if (v4l2src->bayer_fmt.packed) {
+            info.stride[0] = (info.width * v4l2src->bayer_fmt.depth + 7) / 8;
+            info.size = info.stride[0] * info.height;
+        }
+
+        v4l2_fmt = v4l2src->bayer_fmt.v4l2fmt;
+        v4l2src->repack = v4l2src->bayer_fmt.packed ||
+            !gst_structure_has_name(gst_caps_get_structure(caps, 0), "video/x-bayer");
+
+        if (v4l2src->repack)
+            GST_INFO_OBJECT(v4l2src, "capture %s%s, %s", format,
+                v4l2src->bayer_fmt.packed ? " packed" : "",
+                GST_VIDEO_INFO_FORMAT(&out_info) == GST_VIDEO_FORMAT_NV12 ? "demosaic to NV12" : "unpack");
+    } else {
+        v4l2src->repack = v4l2src->tensor_out ||
+            GST_VIDEO_INFO_FORMAT(&info) != GST_VIDEO_INFO_FORMAT(&out_info);
+
+        if (v4l2src->tensor_out)
+            GST_INFO_OBJECT(v4l2src, "capture %s %dx%d, tensor %ux%u",
+                GST_VIDEO_INFO_NAME(&info), info.width, info.height,
+                v4l2src->tensor.width, v4l2src->tensor.height);
+        else if (v4l2src->repack)
+            GST_INFO_OBJECT(v4l2src, "capture %s, repack to %s",
+                GST_VIDEO_INFO_NAME(&info), GST_VIDEO_INFO_NAME(&out_info));
+
+        v4l2_fmt = gst_sunxiv_v4l2_fmt_gst2v4l2(GST_VIDEO_INFO_FORMAT(&info));
+    }
+
+    if (!v4l2_fmt) {
+        GST_ERROR_OBJECT(v4l2src, "%s not supported", GST_VIDEO_INFO_NAME(&info));
+        gst_caps_unref(capture_caps);
+        return FALSE;
+    }
+
+    if (v4l2src->sw_crop && v4l2src->repack) {
+        GST_ERROR_OBJECT(v4l2src, "no crop in the VIN, %s output can't be cropped",
+            GST_VIDEO_INFO_NAME(&out_info));
+        gst_caps_unref(capture_caps);
+        return FALSE;
+    }
+
+    GST_DEBUG("[%c%c%c%c]", v4l2_fmt & 0xff, (v4l2_fmt >> 8) & 0xff, 
+                (v4l2_fmt >> 16) & 0xff, (v4l2_fmt >> 24) & 0xff);
+    GstVideoFormat gst_fmt = gst_video_format_from_fourcc(v4l2_fmt);
+
+    v4l2src->v4l2fmt = v4l2_fmt;
+
+    /* strides and padding are the driver's, not the ones gstreamer computes */
+    gst_video_alignment_reset(&v4l2src->video_align);
+
+    /* the format is set at the sensor size, a hardware crop comes on top */
+    try_info = info;
+    try_info.width = v4l2src->sensor_width;
+    try_info.height = v4l2src->sensor_height;
+
+    if (gst_sunxiv4l2_try_format(v4l2src->v4l2handle, v4l2_fmt, &try_info, &layout) < 0) {
+        GST_WARNING_OBJECT(v4l2src, "no layout from the driver, assume a tight one.");
+    } else if (v4l2src->bayer) {
+        info.stride[0] = MAX((guint)info.stride[0], layout.bytesperline[0]);
+        info.size = MAX(info.stride[0] * info.height, layout.sizeimage[0]);
+    } else if (!gst_sunxi_video_info_apply_layout(&info, &layout, &v4l2src->video_align)) {
+        GST_WARNING_OBJECT(v4l2src, "can't describe %u planes, bytesperline %u of %s %dx%d.",
+            layout.n_planes, layout.bytesperline[0], GST_VIDEO_INFO_NAME(&info), info.width, info.height);
+    }
+
+    if (!v4l2src->repack && !v4l2src->tensor_out && !v4l2src->sw_crop) {
+        /* the native frame goes out as it is, padding included */
+        memcpy(out_info.offset, info.offset, sizeof(info.offset));
+        memcpy(out_info.stride, info.stride, sizeof(info.stride));
+        out_info.size = info.size;
+    }
+
+    GST_DEBUG_OBJECT(v4l2src, "stride %d/%d/%d offset %" G_GSIZE_FORMAT "/%" G_GSIZE_FORMAT
+        "/%" G_GSIZE_FORMAT " size %" G_GSIZE_FORMAT, info.stride[0], info.stride[1], info.stride[2],
+        info.offset[0], info.offset[1], info.offset[2], info.size);
+
+    if (info.fps_n > 0)
+        v4l2src->duration = gst_util_uint64_scale_int(GST_SECOND, info.fps_d, info.fps_n);
+    else
+        v4l2src->duration = GST_CLOCK_TIME_NONE;
+
+    /* the sensor runs at the full rate, skipped frames never leave the driver */
+    v4l2src->decimation = gst_sunxi_v4l2src_sensor_rate(v4l2src, capture_caps, &info);
+    v4l2src->decimate_phase = 0;
+
+    gst_caps_unref(capture_caps);
+
+    GST_DEBUG_OBJECT(v4l2src, "sensor %d/%d fps, push 1 of %u frames",
+        info.fps_n, info.fps_d, v4l2src->decimation);
+
+    memcpy(&v4l2src->info, &info, sizeof(info));
+    memcpy(&v4l2src->out_info, &out_info, sizeof(out_info));
+
+    gst_sunxi_v4l2src_preview_setup(v4l2src);
+
+    if ((v4l2src->luma_stats || v4l2src->static_threshold) && !gst_sunxiv4l2_luma_supported(&info))
+        GST_WARNING_OBJECT(v4l2src, "no 8 bit luma plane in %s, luma stats and static suppression off.",
+            gst_video_format_to_string(GST_VIDEO_INFO_FORMAT(&info)));
+
+    /* FIXME Add device reset*/
+
+    if (v4l2src->old_caps) {
+        gst_caps_unref(v4l2src->old_caps);
+        v4l2src->old_caps = NULL;
+    }
+
+    v4l2src->old_caps = gst_caps_copy(caps);
+
+    return TRUE;
+}
+
+static GstCaps *
+gst_sunxiv4l2src_fixate(GstBaseSrc *bsrc, GstCaps *caps)
+{
+    GstSunxiV4l2Src *v4l2src = GST_SUNXI_V4L2SRC(bsrc);
+    GstStructure *structure;
+    guint i;
+
+    /* after a source change prefer what it sends now */
+    if (v4l2src->source_width && v4l2src->source_height) {
+        caps = gst_caps_make_writable(caps);
+
+        for (i = 0; i < gst_caps_get_size(caps); i++) {
+            structure = gst_caps_get_structure(caps, i);
+            gst_structure_fixate_field_nearest_int(structure, "width", v4l2src->source_width);
+            gst_structure_fixate_field_nearest_int(structure, "height", v4l2src->source_height);
+        }
+    }
+
+    caps = GST_BASE_SRC_CLASS(parent_class)->fixate(bsrc, caps);
+
+    return caps;
+}
+
+static GstCaps *
+gst_sunxiv4l2src_get_caps(GstBaseSrc *bsrc, GstCaps *filter)
+{
+    GstCaps *caps = NULL;
+
+    caps = gst_sunxi_v4l2src_get_device_caps(bsrc);
+
+    if (caps && GST_SUNXI_V4L2SRC(bsrc)->probed_caps) {
+        caps = gst_sunxi_v4l2src_crop_caps(GST_SUNXI_V4L2SRC(bsrc), caps);
+        caps = gst_sunxi_v4l2src_derive_caps(caps);
+        caps = gst_sunxi_v4l2src_decimate_caps(GST_SUNXI_V4L2SRC(bsrc), caps);
+
+        if (GST_SUNXI_V4L2SRC(bsrc)->tensor.type != GST_SUNXI_TENSOR_NONE)
+            caps = gst_sunxi_v4l2src_tensor_caps(GST_SUNXI_V4L2SRC(bsrc), caps);
+    }
+
+    if (caps && filter)
+    {
+        GstCaps *intersection;
+
+        intersection = gst_caps_intersect_full(filter, caps, GST_CAPS_INTERSECT_FIRST);
+        gst_caps_unref(caps);
+        caps = intersection;
+    }
+
+    return caps;
+}
+
+/*
+ * Follow downstream capacity: one more sensor frame per output frame is
+ * dropped in the driver while the smoothed QoS proportion says overload,
+ * and one is taken back once the load predicted at the lower factor fits.
+ * Changes are at least QOS_HOLD_US apart so the measurement can settle.
+ */
+static void
+gst_sunxi_v4l2src_handle_qos(GstSunxiV4l2Src *v4l2src, GstEvent *event)
+{
+    GstQOSType type;
+    gdouble proportion;
+    GstClockTimeDiff diff;
+    GstClockTime timestamp;
+    gint factor, old;
+    gint64 now;
+
+    gst_event_parse_qos(event, &type, &proportion, &diff, &timestamp);
+
+    /* throttling is a deliberate rate limit, not overload */
+    if (type == GST_QOS_TYPE_THROTTLE)
+        return;
+
+    GST_OBJECT_LOCK(v4l2src);
+
+    v4l2src->qos_proportion = (7 * v4l2src->qos_proportion + proportion) / 8;
+    factor = old = v4l2src->qos_factor;
+    now = g_get_monotonic_time();
+
+    if (now - v4l2src->qos_changed >= QOS_HOLD_US) {
+        if (v4l2src->qos_proportion > QOS_OVERLOAD && factor < QOS_MAX_FACTOR)
+            factor++;
+        else if (factor > 1 && v4l2src->qos_proportion * factor < QOS_RECOVER * (factor - 1))
+            factor--;
+    }
+
+    if (factor != old) {
+        g_atomic_int_set(&v4l2src->qos_factor, factor);
+        v4l2src->qos_changed = now;
+        /* start the estimate over at the new rate */
+        v4l2src->qos_proportion = 1.0;
+    }
+
+    GST_OBJECT_UNLOCK(v4l2src);
+
+    if (factor != old)
+        GST_INFO_OBJECT(v4l2src, "downstream proportion %.2f, push 1 of %d frames", proportion,
+            factor * v4l2src->decimation);
+}
+
+static gboolean
+gst_sunxiv4l2src_event(GstBaseSrc *bsrc, GstEvent *event)
+{
+    GstSunxiV4l2Src *v4l2src = GST_SUNXI_V4L2SRC(bsrc);
+
+    if (GST_EVENT_TYPE(event) == GST_EVENT_QOS && v4l2src->qos_decimate)
+        gst_sunxi_v4l2src_handle_qos(v4l2src, event);
+
+    return GST_BASE_SRC_CLASS(parent_class)->event(bsrc, event);
+}
+
+static gboolean
+gst_sunxiv4l2src_query(GstBaseSrc *bsrc, GstQuery *query)
+{
+    GstSunxiV4l2Src *src;
+    gboolean ret = FALSE;
+
+    src = GST_SUNXI_V4L2SRC(bsrc);
+
+    switch(GST_QUERY_TYPE(query)) {
+        case GST_QUERY_LATENCY: {
+            GstClockTime min_latency, max_latency;
+            guint32 fps_n, fps_d;
+            guint num_buffers = 0;
+            GstStructure *config;
+            if (!gst_sunxiv4l2_is_open(src->v4l2handle)) {
+                GST_WARNING("Can't give latency since device isn't open!");
+                goto done;
+            }
+
+            fps_n = gst_sunxiv4l2_fps_n(src->v4l2handle);
+            fps_d = gst_sunxiv4l2_fps_d(src->v4l2handle);
+
+            if (fps_n <= 0 || fps_d <= 0) {
+                GST_WARNING("Can't give latency since framerate isn't fixated !");
+                goto done;
+            }
+
+            min_latency = gst_util_uint64_scale_int(GST_SECOND, fps_d, fps_n);
+
+            /* what frames really take from capture to push, once measured */
+            if (src->capture_latency)
+                min_latency = src->capture_latency;
+
+            /* the first frame of a batch waits for the rest */
+            if (src->batch_max > 1)
+                min_latency += src->batch_latency;
+
+            if (src->pool != NULL) {
+                config = gst_buffer_pool_get_config(src->pool);
+                gst_buffer_pool_config_get_params(config, NULL, NULL, NULL, &num_buffers);
+            }
+
+            if (num_buffers == 0)
+                max_latency = -1;
+            else
+                max_latency = MAX(num_buffers * gst_util_uint64_scale_int(GST_SECOND, fps_d, fps_n), min_latency);
+
+            GST_DEBUG("report latency min %" GST_TIME_FORMAT " max %" GST_TIME_FORMAT,
+                GST_TIME_ARGS(min_latency), GST_TIME_ARGS(max_latency));
+
+            gst_query_set_latency(query, TRUE, min_latency, max_latency);
+
+            ret = TRUE;                
+        }
+        break;
+        default:
+            ret = GST_BASE_SRC_CLASS(parent_class)->query(bsrc, query);
+            break;
+    }
+
+done:
+    return ret;
+}
+
+static gint
+gst_sunxi_v4l2src_config(GstSunxiV4l2Src *v4l2src)
+{
+    guint w, h;
+
+    /* the sensor mode is the full frame, a hardware crop comes on top;
+     * padding is the driver's business and already in the plane layout */
+    w = v4l2src->sensor_width;
+    h = v4l2src->sensor_height;
+
+    GST_DEBUG("%d * %d pading: (%d, %d), (%d, %d) fps:%d/%d",
+        w,h,
+        v4l2src->video_align.padding_left, v4l2src->video_align.padding_top,
+        v4l2src->video_align.padding_right, v4l2src->video_align.padding_bottom,
+        v4l2src->info.fps_n, v4l2src->info.fps_d);
+
+    return gst_sunxi_v4l2capture_config(v4l2src->v4l2handle, v4l2src->v4l2fmt, w, h, v4l2src->info.fps_n, v4l2src->info.fps_d);
+}
+
+/*
+ * The layout the driver really set, after S_FMT and the crop. Frames
+ * described by video meta follow it, anything else can't be told and
+ * fails.
+ */
+static gboolean
+gst_sunxi_v4l2src_check_layout(GstSunxiV4l2Src *v4l2src, const GstSunxiPlaneLayout *layout)
+{
+    GstVideoInfo info;
+    GstVideoAlignment align;
+    guint i;
+
+    if (!layout->n_planes || !layout->bytesperline[0])
+        return TRUE;
+
+    for (i = 0; i < layout->n_planes; i++)
+        if (layout->bytesperline[i] != (guint)v4l2src->info.stride[i])
+            break;
+
+    if (i == layout->n_planes)
+        return TRUE;
+
+    GST_INFO_OBJECT(v4l2src, "driver stride %u, negotiated %d, follow the driver.",
+        layout->bytesperline[i], v4l2src->info.stride[i]);
+
+    memcpy(&info, &v4l2src->info, sizeof(info));
+
+    if (v4l2src->bayer) {
+        info.stride[0] = layout->bytesperline[0];
+        info.size = MAX(info.stride[0] * info.height, layout->sizeimage[0]);
+        gst_video_alignment_reset(&align);
+    } else if (!gst_sunxi_video_info_apply_layout(&info, layout, &align)) {
+        GST_ERROR_OBJECT(v4l2src, "can't describe %u planes, bytesperline %u of %s %dx%d.",
+            layout->n_planes, layout->bytesperline[0], GST_VIDEO_INFO_NAME(&info), info.width, info.height);
+        return FALSE;
+    }
+
+    if (!v4l2src->repack && !v4l2src->tensor_out && !v4l2src->sw_crop) {
+        /* native frames go out as they are, downstream reads the layout
+         * from the video meta or assumes the negotiated one */
+        if (!v4l2src->video_meta) {
+            GST_ERROR_OBJECT(v4l2src, "driver stride %u differs from the negotiated %d, no video meta to say so.",
+                layout->bytesperline[0], v4l2src->info.stride[0]);
+            return FALSE;
+        }
+
+        memcpy(v4l2src->out_info.offset, info.offset, sizeof(info.offset));
+        memcpy(v4l2src->out_info.stride, info.stride, sizeof(info.stride));
+        v4l2src->out_info.size = info.size;
+    }
+
+    memcpy(&v4l2src->info, &info, sizeof(info));
+    v4l2src->video_align = align;
+
+    return TRUE;
+}
+
+static gint
+gst_sunxi_v4l2_callocator_cb(gpointer user_data, gint *buffer_count)
+{
+    GstSunxiV4l2Src *v4l2src = GST_SUNXI_V4L2SRC(user_data);
+    GstSunxiPlaneLayout layout;
+    gint ret;
+    guint min, max;
+
+    if (!v4l2src->pool)
+        v4l2src->pool = gst_base_src_get_buffer_pool(GST_BASE_SRC(v4l2src));
+    if (v4l2src->pool) {
+        GstStructure *config;
+        config = gst_buffer_pool_get_config(v4l2src->pool);
+
+        gst_buffer_pool_config_get_params(config, NULL, NULL, &min, &max);
+        GST_DEBUG("need allocated %d buffers.", max);
+
+        gst_structure_free(config);
+
+        if (gst_sunxi_v4l2src_config(v4l2src) < 0) {
+            GST_ERROR_OBJECT(v4l2src, "camera configuration failed.");
+            g_print("capture device: %s probed caps: %"GST_PTR_FORMAT, v4l2src->device, v4l2src->probed_caps);
+            g_print("Please config accepted caps!\n");
+            return -1;
         }
 
         ret = gst_sunxi_v4l2_set_format(v4l2src->v4l2handle, v4l2src->v4l2fmt, &v4l2src->info);
 
-        if (ret < 0) {
-            return -1;
-        }
+        if (ret < 0) {
+            return -1;
+        }
+
+        if (v4l2src->hw_crop) {
+            if (gst_sunxiv4l2_set_crop(v4l2src->v4l2handle, &v4l2src->crop) < 0) {
+                GST_ERROR_OBJECT(v4l2src, "crop %ux%u at (%d, %d) rejected.",
+                    v4l2src->crop.width, v4l2src->crop.height, v4l2src->crop.left, v4l2src->crop.top);
+                return -1;
+            }
+
+            if (gst_sunxiv4l2_refresh_layout(v4l2src->v4l2handle) < 0)
+                return -1;
+        }
+
+        gst_sunxiv4l2_get_layout(v4l2src->v4l2handle, &layout);
+
+        if (!gst_sunxi_v4l2src_check_layout(v4l2src, &layout))
+            return -1;
+
+        if (gst_sunxi_v4l2_set_buffer_count(v4l2src->v4l2handle, max, v4l2src->io_mode) < 0) {
+            return -1;
+        }
+
+        *buffer_count = max;
+
+    } else {
+        GST_ERROR_OBJECT(v4l2src, "no pool to get buffer count.\n");
+        return -1;
+    }
+
+    return ret;
+}
+
+static GstFlowReturn
+gst_sunxi_v4l2src_register_buffer(GstSunxiV4l2Src *v4l2src)
+{
+    GstBufferPool *pool;
+    GstAllocator *allocator;
+    pool = v4l2src->pool;
+    GstStructure *config;
+
+    config = gst_buffer_pool_get_config(pool);
+
+    g_return_val_if_fail(config != NULL, GST_FLOW_ERROR);
+
+    if (gst_buffer_pool_config_get_allocator(config, &allocator, NULL) == FALSE) {
+        GST_ERROR("Get allocator FAILED");
+        gst_structure_free(config);
+        return GST_FLOW_ERROR;
+    }
+
+    if (!v4l2src->allocator)
+        v4l2src->allocator = gst_object_ref(allocator);
+
+    gst_structure_free(config);
+
+    return gst_sunxi_v4l2_buffer_register(allocator);
+}
+
+/* what the thread had before the capture settings, task threads go back to a pool */
+struct _GstSunxiV4l2SrcSched {
+    gboolean cpus_changed;
+    cpu_set_t cpus;
+    gboolean policy_changed;
+    gint policy;
+    struct sched_param param;
+};
+
+static void
+gst_sunxi_v4l2src_restore_scheduling(GstSunxiV4l2Src *v4l2src, GstSunxiV4l2SrcSched *orig)
+{
+    pthread_t thread = pthread_self();
+    gint ret;
+
+    if (orig->cpus_changed) {
+        ret = pthread_setaffinity_np(thread, sizeof(orig->cpus), &orig->cpus);
+        if (ret)
+            GST_WARNING_OBJECT(v4l2src, "restore cpu affinity failed (%d)", ret);
+        orig->cpus_changed = FALSE;
+    }
+
+    if (orig->policy_changed) {
+        ret = pthread_setschedparam(thread, orig->policy, &orig->param);
+        if (ret)
+            GST_WARNING_OBJECT(v4l2src, "restore scheduling policy %d failed (%d)", orig->policy, ret);
+        orig->policy_changed = FALSE;
+    }
+}
+
+/* undo what an earlier call set, then apply the current settings */
+static void
+gst_sunxi_v4l2src_apply_scheduling(GstSunxiV4l2Src *v4l2src, GstSunxiV4l2SrcSched *orig)
+{
+    pthread_t thread = pthread_self();
+    struct sched_param param;
+    cpu_set_t cpuset;
+    gint i, ret, policy;
+
+    gst_sunxi_v4l2src_restore_scheduling(v4l2src, orig);
+
+    if (v4l2src->cpu_affinity) {
+        ret = pthread_getaffinity_np(thread, sizeof(orig->cpus), &orig->cpus);
+        if (ret) {
+            GST_WARNING_OBJECT(v4l2src, "get cpu affinity failed (%d), keep it", ret);
+            goto policy;
+        }
+
+        CPU_ZERO(&cpuset);
+        for (i = 0; i < 32; i++) {
+            if (v4l2src->cpu_affinity & (1u << i))
+                CPU_SET(i, &cpuset);
+        }
+
+        ret = pthread_setaffinity_np(thread, sizeof(cpuset), &cpuset);
+        if (ret) {
+            GST_WARNING_OBJECT(v4l2src, "set cpu affinity 0x%x failed (%d)", v4l2src->cpu_affinity, ret);
+        } else {
+            GST_INFO_OBJECT(v4l2src, "capture thread bound to cpus 0x%x", v4l2src->cpu_affinity);
+            orig->cpus_changed = TRUE;
+        }
+    }
+
+policy:
+    if (v4l2src->rt_priority > 0) {
+        ret = pthread_getschedparam(thread, &orig->policy, &orig->param);
+        if (ret) {
+            GST_WARNING_OBJECT(v4l2src, "get scheduling policy failed (%d), keep it", ret);
+            return;
+        }
+
+        policy = v4l2src->rt_policy == GST_SUNXI_V4L2SRC_RT_POLICY_RR ? SCHED_RR : SCHED_FIFO;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = CLAMP(v4l2src->rt_priority,
+            sched_get_priority_min(policy), sched_get_priority_max(policy));
+
+        ret = pthread_setschedparam(thread, policy, &param);
+        if (ret == EPERM) {
+            /* no CAP_SYS_NICE, keep running with the default policy */
+            GST_WARNING_OBJECT(v4l2src, "no permission for real-time scheduling, "
+                "capture thread keeps the default priority");
+        } else if (ret) {
+            GST_WARNING_OBJECT(v4l2src, "set real-time priority %d failed (%d)", param.sched_priority, ret);
+        } else {
+            GST_INFO_OBJECT(v4l2src, "capture thread runs %s priority %d",
+                policy == SCHED_RR ? "SCHED_RR" : "SCHED_FIFO", param.sched_priority);
+            orig->policy_changed = TRUE;
+        }
+    }
+}
+
+/*
+ * From poll() reporting the frame to the frame in hand. The buffer
+ * timestamp can't be the start, drivers stamping the start of exposure
+ * would count the exposure in.
+ */
+static void
+gst_sunxi_v4l2src_update_sched_latency(GstSunxiV4l2Src *v4l2src, gint64 ready)
+{
+    GstClockTime latency;
+
+    latency = (g_get_monotonic_time() - ready) * GST_USECOND;
+
+    if (v4l2src->sched_latency_avg == 0)
+        v4l2src->sched_latency_avg = latency;
+    else
+        v4l2src->sched_latency_avg = (7 * v4l2src->sched_latency_avg + latency) / 8;
+
+    v4l2src->sched_latency_max = MAX(v4l2src->sched_latency_max, latency);
+}
+
+static GstClock *
+gst_sunxiv4l2src_provide_clock(GstElement *element)
+{
+    GstSunxiV4l2Src *v4l2src = GST_SUNXI_V4L2SRC(element);
+    GstClock *clock = NULL;
+
+    GST_OBJECT_LOCK(v4l2src);
+
+    if (v4l2src->provide_clock) {
+        /* runs on the monotonic clock until frames recalibrate it */
+        if (!v4l2src->clock)
+            v4l2src->clock = gst_object_ref_sink(g_object_new(GST_TYPE_SYSTEM_CLOCK,
+                "name", "GstSunxiV4l2SrcClock", "clock-type", GST_CLOCK_TYPE_MONOTONIC, NULL));
+
+        clock = gst_object_ref(v4l2src->clock);
+    }
+
+    GST_OBJECT_UNLOCK(v4l2src);
+
+    return clock;
+}
+
+/*
+ * Steer the provided clock with the sensor. A delay-locked loop filters
+ * the driver timestamps of the frames; the clock advances one nominal
+ * frame period per frame over the filtered period, so it runs at the
+ * rate of the sensor crystal instead of the system one.
+ */
+static void
+gst_sunxi_v4l2src_clock_update(GstSunxiV4l2Src *v4l2src, const struct v4l2_buffer *v4l2_buf)
+{
+    GstClockTime ts = GST_TIMEVAL_TO_TIME(v4l2_buf->timestamp);
+    GstClockTime nominal, internal, external, num, denom;
+    guint32 frames;
+    gdouble omega, t, e = 0;
+
+    if (!v4l2src->clock || v4l2src->info.fps_n <= 0 ||
+        (v4l2_buf->flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) != V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC)
+        return;
+
+    nominal = gst_util_uint64_scale_int(GST_SECOND, v4l2src->info.fps_d, v4l2src->info.fps_n);
+    frames = v4l2_buf->sequence - v4l2src->pll_sequence;
+
+    if (v4l2src->pll_locked && (frames == 0 || frames > 1000)) {
+        GST_DEBUG_OBJECT(v4l2src, "sequence jumped by %u, restart the sensor clock", frames);
+        v4l2src->pll_locked = FALSE;
+    }
+
+    if (v4l2src->pll_locked) {
+        t = (gdouble)ts - v4l2src->pll_origin;
+
+        /* frames the driver or we skipped were still captured in between */
+        v4l2src->pll_t1 += (gdouble)(frames - 1) * v4l2src->pll_period;
+        e = t - v4l2src->pll_t1;
+
+        if (ABS(e) > 4 * v4l2src->pll_period) {
+            GST_DEBUG_OBJECT(v4l2src, "sensor clock lost lock, error %.0f ns", e);
+            v4l2src->pll_locked = FALSE;
+        }
+    }
+
+    if (!v4l2src->pll_locked) {
+        /* start where the clock is now, no jump for the pipeline */
+        gst_clock_get_calibration(v4l2src->clock, &internal, &external, &num, &denom);
+
+        v4l2src->pll_origin = ts;
+        v4l2src->pll_external = gst_clock_adjust_with_calibration(v4l2src->clock, ts,
+            internal, external, num, denom);
+        v4l2src->pll_period = nominal;
+        v4l2src->pll_t0 = 0;
+        v4l2src->pll_t1 = nominal;
+        v4l2src->pll_sequence = v4l2_buf->sequence;
+        v4l2src->pll_locked = TRUE;
+        return;
+    }
+
+    omega = 2 * G_PI * SENSOR_CLOCK_BANDWIDTH * v4l2src->pll_period / GST_SECOND;
+
+    v4l2src->pll_t0 = v4l2src->pll_t1;
+    v4l2src->pll_t1 += G_SQRT2 * omega * e + v4l2src->pll_period;
+    v4l2src->pll_period += omega * omega * e;
+    v4l2src->pll_external += frames * nominal;
+    v4l2src->pll_sequence = v4l2_buf->sequence;
+
+    /* nominal clock time per filtered monotonic period */
+    gst_clock_set_calibration(v4l2src->clock, v4l2src->pll_origin + (GstClockTime)v4l2src->pll_t0,
+        v4l2src->pll_external, nominal, (GstClockTime)v4l2src->pll_period);
+
+    GST_LOG_OBJECT(v4l2src, "sensor period %.0f ns, nominal %" G_GUINT64_FORMAT ", error %.0f ns",
+        v4l2src->pll_period, nominal, e);
+}
+
+/*
+ * Nothing came for watchdog-timeout (and at least a few frame periods,
+ * for slow sensors) although the driver has buffers to fill.
+ */
+static gboolean
+gst_sunxi_v4l2src_stalled(GstSunxiV4l2Src *v4l2src, gint64 waiting)
+{
+    gint64 limit = (gint64)v4l2src->watchdog_timeout * 1000;
+
+    if (limit == 0 || gst_sunxiv4l2_camera_queued(v4l2src->v4l2handle) == 0)
+        return FALSE;
+
+    if (v4l2src->info.fps_n > 0)
+        limit = MAX(limit, (gint64)gst_util_uint64_scale_int(4 * G_USEC_PER_SEC,
+            v4l2src->info.fps_d, v4l2src->info.fps_n));
+
+    return g_get_monotonic_time() - waiting > limit;
+}
+
+/* sleep between restarts in short slices, unlock() cuts it short */
+static void
+gst_sunxi_v4l2src_backoff(GstSunxiV4l2Src *v4l2src, gint64 delay_us)
+{
+    gint64 end = g_get_monotonic_time() + delay_us;
+    gint64 remain;
+
+    while ((remain = end - g_get_monotonic_time()) > 0 && !g_atomic_int_get(&v4l2src->unlocked))
+        g_usleep(MIN(remain, RECOVERY_BACKOFF_US));
+}
+
+/*
+ * Restart the stream after a capture failure, backing off between the
+ * attempts, and tell the application how it went. The pipeline keeps
+ * running unless every attempt failed.
+ */
+static GstFlowReturn
+gst_sunxi_v4l2src_recover(GstSunxiV4l2Src *v4l2src, const gchar *failure)
+{
+    gint64 start = g_get_monotonic_time();
+    GstClockTime downtime;
+    gboolean recovered = FALSE;
+    guint attempts = 0;
+
+    if (v4l2src->recovery_attempts == 0) {
+        GST_ELEMENT_ERROR(v4l2src, RESOURCE, READ, (NULL), ("capture failed: %s.", failure));
+        return GST_FLOW_ERROR;
+    }
+
+    GST_WARNING_OBJECT(v4l2src, "capture failed: %s, restart the stream", failure);
+
+    while (!recovered && attempts < v4l2src->recovery_attempts) {
+        if (attempts)
+            gst_sunxi_v4l2src_backoff(v4l2src,
+                MIN(RECOVERY_BACKOFF_US << MIN(attempts - 1, 8), RECOVERY_BACKOFF_MAX_US));
+
+        if (g_atomic_int_get(&v4l2src->unlocked))
+            return GST_FLOW_FLUSHING;
+
+        attempts++;
+        recovered = gst_sunxiv4l2_camera_restart(v4l2src->v4l2handle) == 0;
+    }
+
+    downtime = (g_get_monotonic_time() - start) * GST_USECOND;
+
+    if (recovered)
+        v4l2src->recoveries++;
+    else
+        v4l2src->recovery_failures++;
+
+    gst_element_post_message(GST_ELEMENT_CAST(v4l2src),
+        gst_message_new_element(GST_OBJECT_CAST(v4l2src),
+            gst_structure_new("sunxiv4l2src-recovery",
+                "reason", G_TYPE_STRING, failure,
+                "attempts", G_TYPE_UINT, attempts,
+                "recovered", G_TYPE_BOOLEAN, recovered,
+                "downtime", G_TYPE_UINT64, downtime,
+                NULL)));
+
+    if (!recovered) {
+        GST_ELEMENT_ERROR(v4l2src, RESOURCE, READ, (NULL),
+            ("capture failed: %s, %u stream restarts didn't help.", failure, attempts));
+        return GST_FLOW_ERROR;
+    }
+
+    GST_INFO_OBJECT(v4l2src, "stream restarted after %u attempts, down for %" GST_TIME_FORMAT,
+        attempts, GST_TIME_ARGS(downtime));
+
+    v4l2src->error_frames = 0;
+    v4l2src->offset_resync = TRUE;
+    v4l2src->smooth_valid = FALSE;
+
+    /* frames were lost, motion against the last one before means nothing */
+    gst_sunxiv4l2_luma_analyzer_reset(v4l2src->luma);
+
+    return GST_FLOW_OK;
+}
+
+static GstFlowReturn
+gst_sunxi_v4l2src_handle_event(GstSunxiV4l2Src *v4l2src)
+{
+    guint32 changes = 0;
+
+    switch (gst_sunxiv4l2_camera_dequeue_event(v4l2src->v4l2handle, &changes)) {
+    case -1:
+        return gst_sunxi_v4l2src_recover(v4l2src, "dequeue event failed");
+    case V4L2_EVENT_SOURCE_CHANGE:
+        if (!(changes & V4L2_EVENT_SRC_CH_RESOLUTION))
+            return GST_FLOW_OK;
+
+        GST_INFO_OBJECT(v4l2src, "source changed, changes 0x%x", changes);
+        return GST_SUNXI_V4L2SRC_FLOW_SOURCE_CHANGE;
+    case V4L2_EVENT_EOS:
+        GST_INFO_OBJECT(v4l2src, "end of stream from the driver");
+        return GST_FLOW_EOS;
+    default:
+        return GST_FLOW_OK;
+    }
+}
+
+static GstFlowReturn
+gst_sunxi_v4l2src_wait_frame(GstSunxiV4l2Src *v4l2src, struct v4l2_buffer *v4l2_buf, struct v4l2_plane *planes)
+{
+    const gchar *failure;
+    GstFlowReturn flow;
+    gint64 waiting = g_get_monotonic_time();
+    gint64 remain, ready = 0;
+    gint ret, timeout;
+
+    for (;;) {
+        if (g_atomic_int_get(&v4l2src->unlocked))
+            return GST_FLOW_FLUSHING;
+
+        timeout = CAPTURE_POLL_TIMEOUT_MS;
+
+        /* completing a batch, don't wait past its latency bound */
+        if (v4l2src->batch_deadline >= 0) {
+            remain = v4l2src->batch_deadline - g_get_monotonic_time();
+            timeout = remain > 0 ? MIN((remain + 999) / 1000, CAPTURE_POLL_TIMEOUT_MS) : 0;
+        }
+
+        ret = gst_sunxiv4l2_camera_poll(v4l2src->v4l2handle, timeout);
+
+        if (ret < 0) {
+            failure = "wait for camera data failed";
+            goto recover;
+        }
+
+        if (ret == 0) {
+            if (v4l2src->batch_deadline >= 0 &&
+                g_get_monotonic_time() >= v4l2src->batch_deadline)
+                return GST_FLOW_CUSTOM_SUCCESS;
+
+            if (!gst_sunxi_v4l2src_stalled(v4l2src, waiting))
+                continue;
+
+            failure = "stream stalled";
+            goto recover;
+        }
+
+        if (ret & GST_SUNXI_V4L2_POLL_EVENT) {
+            flow = gst_sunxi_v4l2src_handle_event(v4l2src);
+            if (flow != GST_FLOW_OK)
+                return flow;
+        }
+
+        if (!(ret & GST_SUNXI_V4L2_POLL_FRAME))
+            continue;
+
+        ready = g_get_monotonic_time();
+
+        if (gst_sunxiv4l2_camera_dequeue(v4l2src->v4l2handle, v4l2_buf, planes) < 0) {
+            failure = "dequeue camera buffer failed";
+            goto recover;
+        }
+
+        if (!(v4l2_buf->flags & V4L2_BUF_FLAG_ERROR))
+            break;
+
+        /* the driver flags frames it lost data of, don't push those */
+        GST_DEBUG_OBJECT(v4l2src, "buffer %d sequence %u corrupt", v4l2_buf->index, v4l2_buf->sequence);
+        gst_sunxiv4l2_camera_requeue(v4l2src->v4l2handle, v4l2_buf->index);
+
+        v4l2src->corrupt_frames++;
+
+        if (++v4l2src->error_frames < RECOVERY_ERROR_FRAMES)
+            continue;
+
+        failure = "too many corrupt frames";
+
+recover:
+        flow = gst_sunxi_v4l2src_recover(v4l2src, failure);
+        if (flow != GST_FLOW_OK)
+            return flow;
+
+        waiting = g_get_monotonic_time();
+    }
+
+    v4l2src->error_frames = 0;
+
+    gst_sunxi_v4l2src_update_sched_latency(v4l2src, ready);
+    gst_sunxi_v4l2src_clock_update(v4l2src, v4l2_buf);
+
+    return GST_FLOW_OK;
+}
+
+static guint
+gst_sunxi_v4l2src_drain_stale(GstSunxiV4l2Src *v4l2src, struct v4l2_buffer *v4l2_buf, struct v4l2_plane *planes)
+{
+    struct v4l2_buffer next;
+    struct v4l2_plane next_planes[VIDEO_MAX_PLANES];
+    guint dropped = 0;
+    gint ready;
+
+    /* keep only the newest ready frame, everything older goes back */
+    while ((ready = gst_sunxiv4l2_camera_poll(v4l2src->v4l2handle, 0)) > 0 &&
+        (ready & GST_SUNXI_V4L2_POLL_FRAME)) {
+        if (gst_sunxiv4l2_camera_dequeue(v4l2src->v4l2handle, &next, next_planes) < 0)
+            break;
+
+        gst_sunxiv4l2_camera_requeue(v4l2src->v4l2handle, v4l2_buf->index);
+
+        *v4l2_buf = next;
+        if (next.m.planes == next_planes) {
+            memcpy(planes, next_planes, sizeof(next_planes));
+            v4l2_buf->m.planes = planes;
+        }
+
+        dropped++;
+    }
+
+    return dropped;
+}
+
+static guint
+gst_sunxi_v4l2src_threads(GstSunxiV4l2Src *v4l2src)
+{
+    return v4l2src->n_threads ? v4l2src->n_threads : gst_sunxiv4l2_default_threads();
+}
+
+/* statistics of the captured luma, before any conversion */
+static gboolean
+gst_sunxi_v4l2src_luma_stats(GstSunxiV4l2Src *v4l2src, GstMemory *mem,
+                             GstSunxiLumaStats *stats, gdouble *max_diff)
+{
+    GstMapInfo map;
+
+    if (!gst_sunxiv4l2_luma_supported(&v4l2src->info))
+        return FALSE;
+
+    if (!v4l2src->luma)
+        v4l2src->luma = gst_sunxiv4l2_luma_analyzer_new(v4l2src->luma_step);
+
+    if (!gst_memory_map(mem, &map, GST_MAP_READ))
+        return FALSE;
+
+    *max_diff = gst_sunxiv4l2_luma_analyze(v4l2src->luma, &v4l2src->info, map.data, stats);
+
+    gst_memory_unmap(mem, &map);
+
+    GST_LOG_OBJECT(v4l2src, "luma mean %.1f variance %.1f sad %.2f motion %.3f",
+        stats->mean, stats->variance, stats->sad, stats->motion);
+
+    return TRUE;
+}
+
+/* nothing moved since the last pushed frame and no keepalive is due */
+static gboolean
+gst_sunxi_v4l2src_is_static(GstSunxiV4l2Src *v4l2src, gdouble max_diff)
+{
+    gint64 now = g_get_monotonic_time();
+
+    if (max_diff >= 0 && max_diff <= v4l2src->static_threshold &&
+        (!v4l2src->static_keepalive ||
+         now - v4l2src->static_pushed < (gint64)v4l2src->static_keepalive * G_USEC_PER_SEC))
+        return TRUE;
+
+    v4l2src->static_pushed = now;
+
+    return FALSE;
+}
+
+/* box filter the capture buffer, pushed from create() once timestamped */
+static void
+gst_sunxi_v4l2src_make_preview(GstSunxiV4l2Src *v4l2src, GstMemory *mem)
+{
+    GstBuffer *buffer;
+    GstMapInfo src_map, dst_map;
+    GstVideoInfo *info = &v4l2src->preview_info;
+    gboolean busy;
+
+    if (!v4l2src->preview_pad || !GST_VIDEO_INFO_WIDTH(info))
+        return;
 
-        if (gst_sunxi_v4l2_set_buffer_count(v4l2src->v4l2handle, max, v4l2src->io_mode) < 0) {
-            return -1;
+    if (v4l2src->preview_phase++ % v4l2src->preview_interval)
+        return;
+
+    if (!gst_pad_is_linked(v4l2src->preview_pad))
+        return;
+
+    /* the last preview is still on its way, don't scale one more */
+    g_mutex_lock(&v4l2src->preview_lock);
+    busy = v4l2src->preview_queued || v4l2src->preview_pushing || v4l2src->preview_flushing;
+    g_mutex_unlock(&v4l2src->preview_lock);
+
+    if (busy)
+        return;
+
+    if (!v4l2src->preview_pool) {
+        GstStructure *config;
+        GstCaps *caps = gst_video_info_to_caps(info);
+
+        v4l2src->preview_pool = gst_buffer_pool_new();
+        config = gst_buffer_pool_get_config(v4l2src->preview_pool);
+        gst_buffer_pool_config_set_params(config, caps, GST_VIDEO_INFO_SIZE(info), 2, 0);
+        gst_caps_unref(caps);
+
+        if (!gst_buffer_pool_set_config(v4l2src->preview_pool, config) ||
+            !gst_buffer_pool_set_active(v4l2src->preview_pool, TRUE)) {
+            GST_ERROR_OBJECT(v4l2src, "activate preview pool failed.");
+            gst_object_unref(v4l2src->preview_pool);
+            v4l2src->preview_pool = NULL;
+            return;
         }
+    }
 
-        *buffer_count = max;
+    if (gst_buffer_pool_acquire_buffer(v4l2src->preview_pool, &buffer, NULL) != GST_FLOW_OK)
+        return;
+
+    if (!gst_memory_map(mem, &src_map, GST_MAP_READ)) {
+        gst_buffer_unref(buffer);
+        return;
+    }
+
+    if (!gst_buffer_map(buffer, &dst_map, GST_MAP_WRITE)) {
+        gst_memory_unmap(mem, &src_map);
+        gst_buffer_unref(buffer);
+        return;
+    }
+
+    gst_sunxiv4l2_box_downscale(&v4l2src->info, src_map.data, info, dst_map.data,
+        v4l2src->preview_scale, gst_sunxi_v4l2src_threads(v4l2src));
+
+    gst_buffer_unmap(buffer, &dst_map);
+    gst_memory_unmap(mem, &src_map);
+
+    gst_buffer_add_video_meta_full(buffer, GST_VIDEO_FRAME_FLAG_NONE,
+        GST_VIDEO_INFO_FORMAT(info), GST_VIDEO_INFO_WIDTH(info), GST_VIDEO_INFO_HEIGHT(info),
+        GST_VIDEO_INFO_N_PLANES(info), info->offset, info->stride);
+
+    if (v4l2src->preview_pending)
+        gst_buffer_unref(v4l2src->preview_pending);
+
+    v4l2src->preview_pending = buffer;
+}
+
+/* stamp the pending preview like the frame and hand it to the preview task */
+static void
+gst_sunxi_v4l2src_push_preview(GstSunxiV4l2Src *v4l2src, GstBuffer *frame)
+{
+    GstBuffer *buffer = v4l2src->preview_pending;
+
+    if (!buffer)
+        return;
+
+    v4l2src->preview_pending = NULL;
 
+    GST_BUFFER_PTS(buffer) = GST_BUFFER_PTS(frame);
+    GST_BUFFER_DTS(buffer) = GST_BUFFER_DTS(frame);
+    GST_BUFFER_DURATION(buffer) = GST_BUFFER_DURATION_IS_VALID(frame) ?
+        GST_BUFFER_DURATION(frame) * v4l2src->preview_interval : GST_CLOCK_TIME_NONE;
+    GST_BUFFER_OFFSET(buffer) = GST_BUFFER_OFFSET(frame);
+    GST_BUFFER_OFFSET_END(buffer) = GST_BUFFER_OFFSET_END(frame);
+
+    g_mutex_lock(&v4l2src->preview_lock);
+
+    if (v4l2src->preview_flushing) {
+        g_mutex_unlock(&v4l2src->preview_lock);
+        gst_buffer_unref(buffer);
+        return;
+    }
+
+    if (v4l2src->preview_queued)
+        gst_buffer_unref(v4l2src->preview_queued);
+
+    v4l2src->preview_queued = buffer;
+    g_cond_signal(&v4l2src->preview_cond);
+    g_mutex_unlock(&v4l2src->preview_lock);
+}
+
+static void
+gst_sunxi_v4l2src_preview_start_events(GstSunxiV4l2Src *v4l2src, GstPad *pad)
+{
+    GstEvent *event = gst_pad_get_sticky_event(pad, GST_EVENT_STREAM_START, 0);
+    GstSegment segment;
+    GstCaps *caps;
+
+    if (event) {
+        gst_event_unref(event);
     } else {
-        GST_ERROR_OBJECT(v4l2src, "no pool to get buffer count.\n");
-        return -1;
+        gchar *stream_id = gst_pad_create_stream_id(pad, GST_ELEMENT(v4l2src), "preview");
+
+        gst_pad_push_event(pad, gst_event_new_stream_start(stream_id));
+        g_free(stream_id);
     }
 
-    return ret;
+    if (GST_VIDEO_INFO_WIDTH(&v4l2src->preview_info)) {
+        caps = gst_video_info_to_caps(&v4l2src->preview_info);
+        gst_pad_push_event(pad, gst_event_new_caps(caps));
+        gst_caps_unref(caps);
+    }
+
+    GST_OBJECT_LOCK(v4l2src);
+    gst_segment_copy_into(&GST_BASE_SRC(v4l2src)->segment, &segment);
+    GST_OBJECT_UNLOCK(v4l2src);
+    gst_pad_push_event(pad, gst_event_new_segment(&segment));
+
+    v4l2src->preview_need_events = FALSE;
+}
+
+/*
+ * Preview streaming thread. Only the newest preview waits here, a slow
+ * preview branch loses previews instead of holding up create().
+ */
+static void
+gst_sunxi_v4l2src_preview_loop(gpointer data)
+{
+    GstPad *pad = data;
+    GstSunxiV4l2Src *v4l2src = GST_SUNXI_V4L2SRC(GST_PAD_PARENT(pad));
+    GstBuffer *buffer;
+    GstFlowReturn ret;
+    gboolean eos;
+
+    g_mutex_lock(&v4l2src->preview_lock);
+
+    while (!v4l2src->preview_queued && !v4l2src->preview_eos && !v4l2src->preview_flushing)
+        g_cond_wait(&v4l2src->preview_cond, &v4l2src->preview_lock);
+
+    if (v4l2src->preview_flushing) {
+        g_mutex_unlock(&v4l2src->preview_lock);
+        gst_pad_pause_task(pad);
+        return;
+    }
+
+    buffer = v4l2src->preview_queued;
+    eos = v4l2src->preview_eos;
+    v4l2src->preview_queued = NULL;
+    v4l2src->preview_eos = FALSE;
+    v4l2src->preview_pushing = TRUE;
+
+    g_mutex_unlock(&v4l2src->preview_lock);
+
+    if (v4l2src->preview_need_events)
+        gst_sunxi_v4l2src_preview_start_events(v4l2src, pad);
+
+    if (buffer) {
+        ret = gst_pad_push(pad, buffer);
+
+        /* the preview branch never holds up the main stream's error handling */
+        if (ret != GST_FLOW_OK && ret != GST_FLOW_NOT_LINKED && ret != GST_FLOW_FLUSHING)
+            GST_WARNING_OBJECT(v4l2src, "preview push failed %s", gst_flow_get_name(ret));
+    }
+
+    if (eos)
+        gst_pad_push_event(pad, gst_event_new_eos());
+
+    g_mutex_lock(&v4l2src->preview_lock);
+    v4l2src->preview_pushing = FALSE;
+    g_mutex_unlock(&v4l2src->preview_lock);
+
+    if (eos)
+        gst_pad_pause_task(pad);
+}
+
+static void
+gst_sunxi_v4l2src_preview_set_flushing(GstSunxiV4l2Src *v4l2src, gboolean flushing)
+{
+    g_mutex_lock(&v4l2src->preview_lock);
+
+    v4l2src->preview_flushing = flushing;
+
+    if (flushing) {
+        if (v4l2src->preview_queued) {
+            gst_buffer_unref(v4l2src->preview_queued);
+            v4l2src->preview_queued = NULL;
+        }
+
+        v4l2src->preview_eos = FALSE;
+        g_cond_signal(&v4l2src->preview_cond);
+    }
+
+    g_mutex_unlock(&v4l2src->preview_lock);
+}
+
+static gboolean
+gst_sunxi_v4l2src_preview_activate_mode(GstPad *pad, GstObject *parent, GstPadMode mode, gboolean active)
+{
+    GstSunxiV4l2Src *v4l2src = GST_SUNXI_V4L2SRC(parent);
+
+    if (mode != GST_PAD_MODE_PUSH)
+        return FALSE;
+
+    if (active) {
+        gst_sunxi_v4l2src_preview_set_flushing(v4l2src, FALSE);
+        v4l2src->preview_need_events = TRUE;
+
+        return gst_pad_start_task(pad, gst_sunxi_v4l2src_preview_loop, pad, NULL);
+    }
+
+    gst_sunxi_v4l2src_preview_set_flushing(v4l2src, TRUE);
+
+    return gst_pad_stop_task(pad);
+}
+
+/*
+ * The preview pad follows what basesrc sends on the main one: flushes
+ * for seeks, new segments and EOS.
+ */
+static GstPadProbeReturn
+gst_sunxi_v4l2src_preview_forward(GstPad *srcpad, GstPadProbeInfo *info, gpointer user_data)
+{
+    GstSunxiV4l2Src *v4l2src = GST_SUNXI_V4L2SRC(user_data);
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+    GstPad *pad;
+
+    GST_OBJECT_LOCK(v4l2src);
+    pad = v4l2src->preview_pad ? gst_object_ref(v4l2src->preview_pad) : NULL;
+    GST_OBJECT_UNLOCK(v4l2src);
+
+    if (!pad)
+        return GST_PAD_PROBE_OK;
+
+    switch (GST_EVENT_TYPE(event)) {
+    case GST_EVENT_FLUSH_START:
+        gst_pad_push_event(pad, gst_event_ref(event));
+        gst_sunxi_v4l2src_preview_set_flushing(v4l2src, TRUE);
+        gst_pad_pause_task(pad);
+        break;
+    case GST_EVENT_FLUSH_STOP:
+        gst_sunxi_v4l2src_preview_set_flushing(v4l2src, FALSE);
+        gst_pad_push_event(pad, gst_event_ref(event));
+        v4l2src->preview_need_events = TRUE;
+        gst_pad_start_task(pad, gst_sunxi_v4l2src_preview_loop, pad, NULL);
+        break;
+    case GST_EVENT_SEGMENT:
+        /* sent by the preview task ahead of its next buffer */
+        v4l2src->preview_need_events = TRUE;
+        break;
+    case GST_EVENT_EOS:
+        g_mutex_lock(&v4l2src->preview_lock);
+        v4l2src->preview_eos = TRUE;
+        g_cond_signal(&v4l2src->preview_cond);
+        g_mutex_unlock(&v4l2src->preview_lock);
+        break;
+    default:
+        break;
+    }
+
+    gst_object_unref(pad);
+
+    return GST_PAD_PROBE_OK;
+}
+
+static void
+gst_sunxi_v4l2src_preview_reset(GstSunxiV4l2Src *v4l2src)
+{
+    if (v4l2src->preview_pending) {
+        gst_buffer_unref(v4l2src->preview_pending);
+        v4l2src->preview_pending = NULL;
+    }
+
+    if (v4l2src->preview_pool) {
+        gst_buffer_pool_set_active(v4l2src->preview_pool, FALSE);
+        gst_object_unref(v4l2src->preview_pool);
+        v4l2src->preview_pool = NULL;
+    }
+
+    v4l2src->preview_need_events = TRUE;
 }
 
 static GstFlowReturn
-gst_sunxi_v4l2src_register_buffer(GstSunxiV4l2Src *v4l2src)
+gst_sunxi_v4l2src_output_buffer(GstSunxiV4l2Src *v4l2src, GstBuffer **buf)
 {
-    GstBufferPool *pool;
-    GstAllocator *allocator;
-    pool = v4l2src->pool;
-    GstStructure *config;
+    if (!v4l2src->copy_pool) {
+        GstStructure *config;
 
-    config = gst_buffer_pool_get_config(pool);
+        v4l2src->copy_pool = gst_buffer_pool_new();
+        config = gst_buffer_pool_get_config(v4l2src->copy_pool);
+        gst_buffer_pool_config_set_params(config, v4l2src->old_caps,
+            GST_VIDEO_INFO_SIZE(&v4l2src->out_info), 2, 0);
 
-    g_return_val_if_fail(config != NULL, GST_FLOW_ERROR);
+        if (!gst_buffer_pool_set_config(v4l2src->copy_pool, config) ||
+            !gst_buffer_pool_set_active(v4l2src->copy_pool, TRUE)) {
+            GST_ERROR_OBJECT(v4l2src, "activate copy pool failed.");
+            gst_object_unref(v4l2src->copy_pool);
+            v4l2src->copy_pool = NULL;
+            return GST_FLOW_ERROR;
+        }
+    }
 
-    if (gst_buffer_pool_config_get_allocator(config, &allocator, NULL) == FALSE) {
-        GST_ERROR("Get allocator FAILED");
+    return gst_buffer_pool_acquire_buffer(v4l2src->copy_pool, buf, NULL);
+}
+
+static GstFlowReturn
+gst_sunxi_v4l2src_copy_frame(GstSunxiV4l2Src *v4l2src, GstMemory *mem,
+                             gboolean hflip, gboolean vflip, GstBuffer **buf)
+{
+    GstFlowReturn ret;
+    GstBuffer *buffer;
+    GstMapInfo src_map, dst_map;
+
+    ret = gst_sunxi_v4l2src_output_buffer(v4l2src, &buffer);
+
+    if (ret != GST_FLOW_OK)
+        return ret;
+
+    if (!gst_memory_map(mem, &src_map, GST_MAP_READ)) {
+        gst_buffer_unref(buffer);
         return GST_FLOW_ERROR;
     }
 
-    return gst_sunxi_v4l2_buffer_register(allocator);
+    if (!gst_buffer_map(buffer, &dst_map, GST_MAP_WRITE)) {
+        gst_memory_unmap(mem, &src_map);
+        gst_buffer_unref(buffer);
+        return GST_FLOW_ERROR;
+    }
+
+    if (v4l2src->sw_crop)
+        gst_sunxiv4l2_crop(&v4l2src->info, src_map.data, v4l2src->crop.left, v4l2src->crop.top,
+            &v4l2src->out_info, dst_map.data);
+    else if (hflip || vflip)
+        gst_sunxiv4l2_flip(&v4l2src->info, src_map.data, dst_map.data,
+            hflip, vflip, gst_sunxi_v4l2src_threads(v4l2src));
+    else
+        gst_sunxiv4l2_stream_copy(dst_map.data, src_map.data, MIN(src_map.size, dst_map.size));
+
+    gst_buffer_unmap(buffer, &dst_map);
+    gst_memory_unmap(mem, &src_map);
+
+    *buf = buffer;
+
+    return GST_FLOW_OK;
+}
+
+static GstFlowReturn
+gst_sunxi_v4l2src_repack_frame(GstSunxiV4l2Src *v4l2src, GstMemory *mem, GstBuffer **buf)
+{
+    GstFlowReturn ret;
+    GstBuffer *buffer;
+    GstMapInfo src_map, dst_map;
+    guint n_threads;
+
+    ret = gst_sunxi_v4l2src_output_buffer(v4l2src, &buffer);
+
+    if (ret != GST_FLOW_OK)
+        return ret;
+
+    if (!gst_memory_map(mem, &src_map, GST_MAP_READ)) {
+        gst_buffer_unref(buffer);
+        return GST_FLOW_ERROR;
+    }
+
+    if (!gst_buffer_map(buffer, &dst_map, GST_MAP_WRITE)) {
+        gst_memory_unmap(mem, &src_map);
+        gst_buffer_unref(buffer);
+        return GST_FLOW_ERROR;
+    }
+
+    n_threads = gst_sunxi_v4l2src_threads(v4l2src);
+
+    if (v4l2src->tensor_out)
+        gst_sunxiv4l2_tensor(&v4l2src->info, src_map.data, &v4l2src->tensor, dst_map.data, n_threads);
+    else if (!v4l2src->bayer)
+        gst_sunxiv4l2_repack(&v4l2src->info, src_map.data, &v4l2src->out_info, dst_map.data, n_threads);
+    else if (GST_VIDEO_INFO_FORMAT(&v4l2src->out_info) == GST_VIDEO_FORMAT_NV12)
+        gst_sunxiv4l2_demosaic(&v4l2src->bayer_fmt, &v4l2src->info, src_map.data,
+            &v4l2src->out_info, dst_map.data, n_threads);
+    else
+        gst_sunxiv4l2_bayer_unpack(&v4l2src->bayer_fmt, &v4l2src->info, src_map.data,
+            &v4l2src->out_info, dst_map.data, n_threads);
+
+    gst_buffer_unmap(buffer, &dst_map);
+    gst_memory_unmap(mem, &src_map);
+
+    *buf = buffer;
+
+    return GST_FLOW_OK;
+}
+
+static GstStaticCaps monotonic_reference = GST_STATIC_CAPS(GST_SUNXI_CAPTURE_REFERENCE_MONOTONIC);
+
+/* what the driver said about the frame, create() replaces the timestamp */
+static void
+gst_sunxi_v4l2src_add_capture_meta(GstSunxiV4l2Src *v4l2src, GstBuffer *buffer,
+    const struct v4l2_buffer *v4l2_buf)
+{
+    GstSunxiCaptureInfo capture;
+    GstCaps *reference;
+
+    capture.sequence = v4l2_buf->sequence;
+    capture.timestamp = GST_TIMEVAL_TO_TIME(v4l2_buf->timestamp);
+    capture.flags = v4l2_buf->flags;
+    capture.field = v4l2_buf->field;
+    capture.index = v4l2_buf->index;
+    gst_sunxiv4l2_get_exposure(v4l2src->v4l2handle, &capture.exposure, &capture.gain);
+
+    gst_buffer_add_sunxi_capture_meta(buffer, &capture);
+
+    /* only a monotonic timestamp can be lined up with other devices */
+    if ((v4l2_buf->flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC) {
+        reference = gst_static_caps_get(&monotonic_reference);
+        gst_buffer_add_reference_timestamp_meta(buffer, reference, capture.timestamp, v4l2src->duration);
+        gst_caps_unref(reference);
+    }
+}
+
+/*
+ * Put every video plane of the frame in its own memory, in offset order,
+ * so the video meta maps only the plane that is asked for. Takes mem.
+ */
+static void
+gst_sunxi_v4l2src_append_planes(GstSunxiV4l2Src *v4l2src, GstBuffer *buffer,
+    GstMemory *mem, const GstVideoInfo *vinfo)
+{
+    guint n_planes = GST_VIDEO_INFO_N_PLANES(vinfo);
+    gboolean split = gst_sunxi_v4l2_allocator_n_planes(mem) < (gint)n_planes;
+    gsize start = 0, end;
+    GstMemory *plane;
+    guint i, j, next;
+
+    if (n_planes < 2) {
+        gst_buffer_append_memory(buffer, mem);
+        return;
+    }
+
+    for (;;) {
+        /* the plane at the lowest offset not appended yet */
+        next = n_planes;
+        for (i = 0; i < n_planes; i++)
+            if (vinfo->offset[i] >= start && (next == n_planes || vinfo->offset[i] < vinfo->offset[next]))
+                next = i;
+
+        if (next == n_planes)
+            break;
+
+        end = vinfo->size;
+        for (j = 0; j < n_planes; j++)
+            if (vinfo->offset[j] > vinfo->offset[next] && vinfo->offset[j] < end)
+                end = vinfo->offset[j];
+
+        /* one V4L2 plane holding every video plane, or one each */
+        if (split)
+            plane = gst_sunxi_v4l2_allocator_wrap_plane(mem, 0, vinfo->offset[next], end - vinfo->offset[next]);
+        else
+            plane = gst_sunxi_v4l2_allocator_wrap_plane(mem, next, 0, end - vinfo->offset[next]);
+
+        if (!plane) {
+            /* can't split, the buffer still works as one block */
+            GST_WARNING_OBJECT(v4l2src, "plane %u at %" G_GSIZE_FORMAT " doesn't fit the buffer.",
+                next, vinfo->offset[next]);
+            gst_buffer_remove_all_memory(buffer);
+            gst_buffer_append_memory(buffer, mem);
+            return;
+        }
+
+        gst_buffer_append_memory(buffer, plane);
+        start = end;
+    }
+
+    gst_memory_unref(mem);
 }
 
 static GstFlowReturn
 gst_sunxi_v4l2src_acquire_buffer(GstSunxiV4l2Src *v4l2src, GstBuffer **buf)
 {
     GstFlowReturn ret = GST_FLOW_OK;
-    GstVideoMeta *vmeta;
     GstVideoFrameFlags flags = GST_VIDEO_FRAME_FLAG_NONE;
-    GstBufferPool *pool = v4l2src->pool;
+    struct v4l2_buffer v4l2_buf;
+    struct v4l2_plane planes[VIDEO_MAX_PLANES];
+    GstSunxiLumaStats luma;
+    gboolean has_luma = FALSE;
+    gboolean cropped = FALSE;
+    gboolean hflip, vflip;
+    guint decimation;
+    gdouble max_diff;
     GstBuffer *buffer;
+    GstMemory *mem;
+
+    /* basesrc may hand the task to a new thread after a restart */
+    if (v4l2src->sched_thread != g_thread_self()) {
+        gst_sunxi_v4l2src_apply_scheduling(v4l2src, v4l2src->sched_orig);
+        v4l2src->sched_thread = g_thread_self();
+    }
 
     if (v4l2src->stream_on == FALSE) {
 
+        gst_sunxiv4l2_set_device_only(v4l2src->v4l2handle, v4l2src->device_only);
+
         ret = gst_sunxi_v4l2src_register_buffer(v4l2src);
 
         g_return_val_if_fail(ret == GST_FLOW_OK, ret);
@@ -351,54 +2498,238 @@ gst_sunxi_v4l2src_acquire_buffer(GstSunxiV4l2Src *v4l2src, GstBuffer **buf)
 
         g_return_val_if_fail(ret == GST_FLOW_OK, ret);
 
-        ret = gst_buffer_pool_acquire_buffer(pool, &buffer, NULL);
-
-        g_return_val_if_fail(ret == GST_FLOW_OK, ret);
+        gst_sunxi_v4l2src_apply_direction(v4l2src);
 
         v4l2src->stream_on =  gst_sunxi_v4l2_streamon(v4l2src->v4l2handle);
 
-        g_return_val_if_fail(v4l2src->stream_on == TRUE, GST_FLOW_ERROR);
-    } else {
-        ret = gst_buffer_pool_acquire_buffer(pool, &buffer, NULL);
+        g_return_val_if_fail(v4l2src->stream_on == TRUE, GST_FLOW_ERROR);
+    }
+
+next_frame:
+    for (;;) {
+        ret = gst_sunxi_v4l2src_wait_frame(v4l2src, &v4l2_buf, planes);
+
+        if (ret != GST_FLOW_OK)
+            return ret;
+
+        decimation = v4l2src->decimation * g_atomic_int_get(&v4l2src->qos_factor);
+
+        if (decimation <= 1 || (v4l2src->decimate_phase % decimation) == 0) {
+            v4l2src->decimate_phase++;
+            break;
+        }
+
+        /* decimated away, straight back to the driver untouched */
+        gst_sunxiv4l2_camera_requeue(v4l2src->v4l2handle, v4l2_buf.index);
+
+        if (v4l2src->decimate_phase++ % v4l2src->decimation == 0)
+            v4l2src->qos_decimated++;
+        else
+            v4l2src->decimated++;
+        v4l2src->skipped++;
+    }
+
+    if (v4l2src->drop_stale) {
+        guint stale = gst_sunxi_v4l2src_drain_stale(v4l2src, &v4l2_buf, planes);
+
+        v4l2src->stale_pending += stale;
+        v4l2src->stale_dropped += stale;
+        v4l2src->skipped += stale;
+    }
+
+    mem = gst_sunxi_v4l2_allocator_wrap(v4l2src->allocator, v4l2_buf.index);
+
+    if (!mem) {
+        gst_sunxiv4l2_camera_requeue(v4l2src->v4l2handle, v4l2_buf.index);
+        return GST_FLOW_ERROR;
+    }
+
+    if (v4l2src->luma_stats || v4l2src->static_threshold)
+        has_luma = gst_sunxi_v4l2src_luma_stats(v4l2src, mem, &luma, &max_diff);
+
+    if (has_luma && v4l2src->static_threshold &&
+        gst_sunxi_v4l2src_is_static(v4l2src, max_diff)) {
+        /* static scene, keep diffing against the frame downstream has */
+        gst_sunxiv4l2_luma_analyzer_hold(v4l2src->luma);
+        gst_memory_unref(mem);
+        v4l2src->static_suppressed++;
+        v4l2src->skipped++;
+        goto next_frame;
+    }
+
+    gst_sunxi_v4l2src_make_preview(v4l2src, mem);
+
+    /* video-direction may change them while the frame is copied */
+    GST_OBJECT_LOCK(v4l2src);
+    hflip = v4l2src->sw_hflip;
+    vflip = v4l2src->sw_vflip;
+    GST_OBJECT_UNLOCK(v4l2src);
+
+    if (v4l2src->repack) {
+        /* the VIN can't produce this layout, convert on the way out */
+        ret = gst_sunxi_v4l2src_repack_frame(v4l2src, mem, &buffer);
+        gst_memory_unref(mem);
+
+        if (ret != GST_FLOW_OK)
+            return ret;
+    } else if (v4l2src->starvation_threshold > 0 &&
+        gst_sunxiv4l2_camera_queued(v4l2src->v4l2handle) < v4l2src->starvation_threshold) {
+        /* downstream holds (almost) every buffer, copy the frame out and
+         * give the V4L2 buffer straight back so the sensor keeps running */
+        ret = gst_sunxi_v4l2src_copy_frame(v4l2src, mem, hflip, vflip, &buffer);
+        gst_memory_unref(mem);
+
+        if (ret != GST_FLOW_OK)
+            return ret;
+
+        v4l2src->copied++;
+        GST_LOG_OBJECT(v4l2src, "driver queue starving, copied buffer %d", v4l2_buf.index);
+    } else if ((v4l2src->sw_crop && !v4l2src->crop_meta) || hflip || vflip) {
+        /* downstream can't take a crop meta or the device can't flip */
+        ret = gst_sunxi_v4l2src_copy_frame(v4l2src, mem, hflip, vflip, &buffer);
+        gst_memory_unref(mem);
+
+        if (ret != GST_FLOW_OK)
+            return ret;
+    } else {
+        buffer = gst_buffer_new();
+        cropped = v4l2src->sw_crop;
+
+        /* bayer and tensors are one block */
+        if (v4l2src->video_meta)
+            gst_sunxi_v4l2src_append_planes(v4l2src, buffer, mem,
+                cropped ? &v4l2src->info : &v4l2src->out_info);
+        else
+            gst_buffer_append_memory(buffer, mem);
+    }
+
+    /* bayer and tensors have no video format to put in a meta */
+    if (v4l2src->video_meta) {
+        /* a crop meta describes a window of the full frame */
+        GstVideoInfo *vinfo = cropped ? &v4l2src->info : &v4l2src->out_info;
+
+        gst_buffer_add_video_meta_full(buffer, flags,
+            GST_VIDEO_INFO_FORMAT(vinfo),
+            GST_VIDEO_INFO_WIDTH(vinfo),
+            GST_VIDEO_INFO_HEIGHT(vinfo),
+            GST_VIDEO_INFO_N_PLANES(vinfo),
+            vinfo->offset,
+            vinfo->stride);
+    }
+
+    if (cropped) {
+        GstVideoCropMeta *crop = gst_buffer_add_video_crop_meta(buffer);
+
+        crop->x = v4l2src->crop.left;
+        crop->y = v4l2src->crop.top;
+        crop->width = v4l2src->crop.width;
+        crop->height = v4l2src->crop.height;
+    }
+
+    if (has_luma && v4l2src->luma_stats)
+        gst_buffer_add_sunxi_luma_meta(buffer, &luma);
+
+    gst_sunxi_v4l2src_add_capture_meta(v4l2src, buffer, &v4l2_buf);
+
+    /* driver capture time and sequence, consumed by create() */
+    GST_BUFFER_TIMESTAMP(buffer) = GST_TIMEVAL_TO_TIME(v4l2_buf.timestamp);
+    GST_BUFFER_OFFSET(buffer) = v4l2_buf.sequence;
+    GST_BUFFER_OFFSET_END(buffer) = v4l2_buf.sequence + 1;
+
+    *buf = buffer;
+
+    GST_DEBUG("buffer %d sequence %u field type: %d", v4l2_buf.index, v4l2_buf.sequence, flags);
+
+    return ret;
+}
+
+/*
+ * Worst capture to push delay over a window of frames. A new latency is
+ * posted when it moves by more than an eighth (and a millisecond), so
+ * the sinks buffer for what the ISP and the queue actually add.
+ */
+static void
+gst_sunxi_v4l2src_update_latency(GstSunxiV4l2Src *v4l2src, GstClockTime delay)
+{
+    GstClockTime latency, diff;
+
+    v4l2src->latency_window_max = MAX(v4l2src->latency_window_max, delay);
+
+    if (++v4l2src->latency_window_frames < LATENCY_WINDOW_FRAMES)
+        return;
+
+    latency = v4l2src->latency_window_max;
+    v4l2src->latency_window_max = 0;
+    v4l2src->latency_window_frames = 0;
+
+    diff = latency > v4l2src->capture_latency ? latency - v4l2src->capture_latency :
+        v4l2src->capture_latency - latency;
+
+    if (v4l2src->capture_latency && (diff < LATENCY_MIN_CHANGE || diff < v4l2src->capture_latency / 8))
+        return;
+
+    GST_INFO_OBJECT(v4l2src, "capture latency %" GST_TIME_FORMAT " -> %" GST_TIME_FORMAT,
+        GST_TIME_ARGS(v4l2src->capture_latency), GST_TIME_ARGS(latency));
+
+    v4l2src->capture_latency = latency;
+
+    gst_element_post_message(GST_ELEMENT_CAST(v4l2src),
+        gst_message_new_latency(GST_OBJECT_CAST(v4l2src)));
+}
+
+/*
+ * Predict the pts from the last one and the sensor frames in between,
+ * as the sequence numbers count them, and only nudge the prediction
+ * towards the measured pts. Lost frames advance the prediction by whole
+ * periods and keep their gap; a measurement more than half a period off
+ * means the sequence and the timestamps disagree, start over from it.
+ */
+static GstClockTime
+gst_sunxi_v4l2src_smooth_timestamp(GstSunxiV4l2Src *v4l2src, GstClockTime timestamp, guint64 offset)
+{
+    GstClockTime period, predicted;
+    GstClockTimeDiff error;
+    guint64 frames;
 
-        g_return_val_if_fail(ret == GST_FLOW_OK , ret);
-    }
+    if (!GST_CLOCK_TIME_IS_VALID(timestamp) || v4l2src->info.fps_n <= 0)
+        return timestamp;
 
-    vmeta = gst_buffer_get_video_meta(buffer);
+    period = gst_util_uint64_scale_int(GST_SECOND, v4l2src->info.fps_d, v4l2src->info.fps_n);
+    frames = offset - v4l2src->smooth_offset;
 
-    if (!vmeta) {
-        GstVideoInfo info;
+    if (v4l2src->smooth_valid && offset > v4l2src->smooth_offset) {
+        predicted = v4l2src->smooth_pts + frames * period;
+        error = GST_CLOCK_DIFF(predicted, timestamp);
 
-        if (gst_sunxi_video_info_from_caps(&info, v4l2src->old_caps)) {
-            GST_ERROR_OBJECT(v4l2src, "invalid caps.");
-            return GST_FLOW_ERROR;
-        }
+        if (ABS(error) <= (GstClockTimeDiff)period / 2) {
+            v4l2src->smooth_pts = predicted + error / (1 << SMOOTH_GAIN_SHIFT);
+            v4l2src->smooth_offset = offset;
 
-        vmeta->flags = flags;
+            GST_LOG_OBJECT(v4l2src, "pts %" GST_TIME_FORMAT " smoothed by %" G_GINT64_FORMAT " ns",
+                GST_TIME_ARGS(v4l2src->smooth_pts), GST_CLOCK_DIFF(timestamp, v4l2src->smooth_pts));
 
-        vmeta = gst_buffer_add_video_meta(buffer, 
-            GST_VIDEO_FRAME_FLAG_NONE,
-            GST_VIDEO_INFO_FORMAT(&info),
-            v4l2src->info.width,
-            v4l2src->info.height
-        );
-    }    
+            return v4l2src->smooth_pts;
+        }
 
-    *buf = buffer;
+        GST_DEBUG_OBJECT(v4l2src, "%" G_GUINT64_FORMAT " frames in sequence but %" G_GINT64_FORMAT
+            " ns off the period, resync", frames, error);
+        v4l2src->smooth_resyncs++;
+    }
 
-    GST_DEBUG("field type: %d", flags);
+    v4l2src->smooth_pts = timestamp;
+    v4l2src->smooth_offset = offset;
+    v4l2src->smooth_valid = TRUE;
 
-    return ret;
+    return timestamp;
 }
 
 static GstFlowReturn
-gst_sunxi_v4l2src_create(GstPushSrc *psrc, GstBuffer **buf)
+gst_sunxi_v4l2src_create_one(GstSunxiV4l2Src *v4l2src, GstBuffer **buf)
 {
     GstFlowReturn ret;
     GstClockTime delay, abs_time, timestamp, base_time, duration;
     GstClock *clock;
     GstMessage *qos_msg;
-    GstSunxiV4l2Src *v4l2src = GST_SUNXI_V4L2SRC(psrc);
 
     ret = gst_sunxi_v4l2src_acquire_buffer(v4l2src, buf);
 
@@ -410,6 +2741,9 @@ gst_sunxi_v4l2src_create(GstPushSrc *psrc, GstBuffer **buf)
     timestamp = GST_BUFFER_TIMESTAMP(*buf);
     duration = v4l2src->duration;
 
+    if (GST_CLOCK_TIME_IS_VALID(duration))
+        duration *= g_atomic_int_get(&v4l2src->qos_factor);
+
 
     GST_OBJECT_LOCK(v4l2src);
 
@@ -460,6 +2794,8 @@ retry:
 
         v4l2src->last_timestamp = timestamp;
 
+        gst_sunxi_v4l2src_update_latency(v4l2src, delay);
+
         GST_DEBUG("ts: %"GST_TIME_FORMAT " now %" GST_TIME_FORMAT " delay %"GST_TIME_FORMAT, 
             GST_TIME_ARGS(timestamp), GST_TIME_ARGS(gstnow), GST_TIME_ARGS(delay));
     } else {
@@ -494,7 +2830,7 @@ retry:
         v4l2src->ctrl_time = timestamp;
     }
 
-    gst_object_sync_values(GST_OBJECT(psrc), v4l2src->ctrl_time);
+    gst_object_sync_values(GST_OBJECT(v4l2src), v4l2src->ctrl_time);
 
     GST_INFO("sync to %" GST_TIME_FORMAT " out ts %" GST_TIME_FORMAT,
         GST_TIME_ARGS(v4l2src->ctrl_time), GST_TIME_ARGS(timestamp));
@@ -504,12 +2840,18 @@ retry:
         GST_BUFFER_OFFSET(*buf) = v4l2src->offset++;
         GST_BUFFER_OFFSET_END(*buf) = v4l2src->offset;
     } else {
+        /* the sequence starts over with a restarted stream */
+        if (v4l2src->offset_resync) {
+            v4l2src->renegotiation_adjust = v4l2src->offset + 1 - GST_BUFFER_OFFSET(*buf);
+            v4l2src->offset_resync = FALSE;
+        }
+
         GST_BUFFER_OFFSET(*buf) += v4l2src->renegotiation_adjust;
         GST_BUFFER_OFFSET_END(*buf) += v4l2src->renegotiation_adjust;
 
         if ((v4l2src->offset != 0) && 
-            (GST_BUFFER_OFFSET(*buf) != (v4l2src->offset + 1))) {
-            guint64 lost_frame_count = GST_BUFFER_OFFSET(*buf) - v4l2src->offset - 1;
+            (GST_BUFFER_OFFSET(*buf) > (v4l2src->offset + 1 + v4l2src->skipped))) {
+            guint64 lost_frame_count = GST_BUFFER_OFFSET(*buf) - v4l2src->offset - 1 - v4l2src->skipped;
             GST_WARNING("lost frames detected: count = %" G_GUINT64_FORMAT " - ts: %d"
             GST_TIME_FORMAT, lost_frame_count, GST_TIME_ARGS(timestamp));
 
@@ -522,6 +2864,25 @@ retry:
         v4l2src->offset = GST_BUFFER_OFFSET(*buf);
     }
 
+    v4l2src->skipped = 0;
+
+    if (v4l2src->stale_pending) {
+        GST_DEBUG("dropped %u stale frames", v4l2src->stale_pending);
+
+        qos_msg = gst_message_new_qos(GST_OBJECT_CAST(v4l2src), TRUE,
+            GST_CLOCK_TIME_NONE, GST_CLOCK_TIME_NONE, timestamp,
+            GST_CLOCK_TIME_IS_VALID(duration) ? v4l2src->stale_pending *
+            duration : GST_CLOCK_TIME_NONE);
+        gst_message_set_qos_stats(qos_msg, GST_FORMAT_BUFFERS,
+            v4l2src->offset, v4l2src->stale_dropped);
+        gst_element_post_message(GST_ELEMENT_CAST(v4l2src), qos_msg);
+
+        v4l2src->stale_pending = 0;
+    }
+
+    if (v4l2src->smooth_timestamps)
+        timestamp = gst_sunxi_v4l2src_smooth_timestamp(v4l2src, timestamp, GST_BUFFER_OFFSET(*buf));
+
     GST_DEBUG("timestamp: %" GST_TIME_FORMAT " duration: %" GST_TIME_FORMAT
       , GST_TIME_ARGS (timestamp), GST_TIME_ARGS (duration));
 
@@ -530,6 +2891,413 @@ retry:
     GST_BUFFER_DTS (*buf) = timestamp;
     GST_BUFFER_DURATION(*buf) = duration;
 
+    gst_sunxi_v4l2src_push_preview(v4l2src, *buf);
+
+    return ret;
+}
+
+/* drop the buffers, pools and caps of the old format, FALSE if the driver can't */
+static gboolean
+gst_sunxi_v4l2src_release(GstSunxiV4l2Src *v4l2src)
+{
+    gboolean orphans = gst_sunxiv4l2_orphans_supported(v4l2src->v4l2handle);
+    gboolean released = TRUE;
+
+    if (v4l2src->pool) {
+        gst_buffer_pool_set_active(v4l2src->pool, FALSE);
+        gst_object_unref(v4l2src->pool);
+        v4l2src->pool = NULL;
+    }
+
+    if (v4l2src->copy_pool) {
+        gst_buffer_pool_set_active(v4l2src->copy_pool, FALSE);
+        gst_object_unref(v4l2src->copy_pool);
+        v4l2src->copy_pool = NULL;
+    }
+
+    /* frames still downstream must not go back to the new queue; unless
+     * the driver orphans them they have to come back before REQBUFS(0).
+     * The allocator stays until they did, a later call waits again. */
+    if (v4l2src->allocator) {
+        released = gst_sunxi_v4l2_allocator_release(v4l2src->allocator,
+            orphans ? 0 : SOURCE_CHANGE_RELEASE_TIMEOUT_US, &v4l2src->unlocked);
+
+        if (released || orphans) {
+            gst_object_unref(v4l2src->allocator);
+            v4l2src->allocator = NULL;
+        }
+    }
+
+    v4l2src->stream_on = FALSE;
+
+    if (!released && !orphans) {
+        GST_ERROR_OBJECT(v4l2src, "frames still downstream and no orphaned buffers in the driver.");
+        return FALSE;
+    }
+
+    if (gst_sunxiv4l2_release_buffers(v4l2src->v4l2handle) < 0) {
+        GST_ERROR_OBJECT(v4l2src, "driver kept the old buffers.");
+        return FALSE;
+    }
+
+    if (v4l2src->probed_caps) {
+        gst_caps_unref(v4l2src->probed_caps);
+        v4l2src->probed_caps = NULL;
+    }
+
+    if (v4l2src->old_caps) {
+        gst_caps_unref(v4l2src->old_caps);
+        v4l2src->old_caps = NULL;
+    }
+
+    v4l2src->pll_locked = FALSE;
+    v4l2src->smooth_valid = FALSE;
+    v4l2src->latency_window_max = 0;
+    v4l2src->latency_window_frames = 0;
+
+    return TRUE;
+}
+
+/*
+ * No signal after a source change, the stream stays off. Sleep on the
+ * events until the source reports again; polling for frames would return
+ * at once on a queue that isn't streaming. Without events, look again
+ * every poll timeout.
+ */
+static GstFlowReturn
+gst_sunxi_v4l2src_wait_source(GstSunxiV4l2Src *v4l2src)
+{
+    GstFlowReturn flow;
+    gint ret;
+
+    for (;;) {
+        if (g_atomic_int_get(&v4l2src->unlocked)) {
+            v4l2src->pending_flow = GST_SUNXI_V4L2SRC_FLOW_SOURCE_CHANGE;
+            return GST_FLOW_FLUSHING;
+        }
+
+        ret = gst_sunxiv4l2_camera_wait_event(v4l2src->v4l2handle, CAPTURE_POLL_TIMEOUT_MS);
+
+        if (ret == 0)
+            continue;
+
+        if (ret < 0) {
+            gst_sunxi_v4l2src_backoff(v4l2src, CAPTURE_POLL_TIMEOUT_MS * 1000);
+            return GST_SUNXI_V4L2SRC_FLOW_SOURCE_CHANGE;
+        }
+
+        flow = gst_sunxi_v4l2src_handle_event(v4l2src);
+        if (flow != GST_FLOW_OK)
+            return flow;
+    }
+}
+
+/*
+ * The source switched timing: stop and see what it sends now. The same
+ * format only needs a stream restart, anything else drops the buffers
+ * and renegotiates from the streaming thread, new caps go downstream
+ * and the pipeline keeps running. Without a signal the stream stays
+ * off until the next change.
+ */
+static GstFlowReturn
+gst_sunxi_v4l2src_source_change(GstSunxiV4l2Src *v4l2src)
+{
+    guint v4l2fmt, width, height;
+
+    v4l2src->source_changes++;
+
+    gst_sunxi_v4l2_streamoff(v4l2src->v4l2handle);
+
+    if (gst_sunxiv4l2_query_source(v4l2src->v4l2handle, &v4l2fmt, &width, &height) < 0) {
+        GST_WARNING_OBJECT(v4l2src, "nothing to capture after the source change, wait for the next");
+        return gst_sunxi_v4l2src_wait_source(v4l2src);
+    }
+
+    GST_INFO_OBJECT(v4l2src, "source sends %" GST_FOURCC_FORMAT " %ux%u, capturing %" GST_FOURCC_FORMAT
+        " %ux%u", GST_FOURCC_ARGS(v4l2fmt), width, height, GST_FOURCC_ARGS(v4l2src->v4l2fmt),
+        v4l2src->sensor_width, v4l2src->sensor_height);
+
+    gst_element_post_message(GST_ELEMENT_CAST(v4l2src),
+        gst_message_new_element(GST_OBJECT_CAST(v4l2src),
+            gst_structure_new("sunxiv4l2src-source-change",
+                "fourcc", G_TYPE_UINT, v4l2fmt,
+                "width", G_TYPE_UINT, width,
+                "height", G_TYPE_UINT, height,
+                NULL)));
+
+    v4l2src->source_width = width;
+    v4l2src->source_height = height;
+    v4l2src->offset_resync = TRUE;
+
+    gst_sunxiv4l2_luma_analyzer_reset(v4l2src->luma);
+
+    /* without a pool an earlier change is still being released */
+    if (v4l2src->pool && v4l2fmt == v4l2src->v4l2fmt &&
+        width == v4l2src->sensor_width && height == v4l2src->sensor_height) {
+        if (gst_sunxiv4l2_camera_restart(v4l2src->v4l2handle) < 0)
+            return gst_sunxi_v4l2src_recover(v4l2src, "restart after a source change failed");
+
+        return GST_FLOW_OK;
+    }
+
+    if (!gst_sunxi_v4l2src_release(v4l2src)) {
+        if (g_atomic_int_get(&v4l2src->unlocked)) {
+            /* paused or flushed half way, the next create() finishes it */
+            v4l2src->pending_flow = GST_SUNXI_V4L2SRC_FLOW_SOURCE_CHANGE;
+            return GST_FLOW_FLUSHING;
+        }
+
+        GST_ELEMENT_ERROR(v4l2src, RESOURCE, BUSY, (NULL),
+            ("can't release the capture buffers for %ux%u after the source changed.", width, height));
+        return GST_FLOW_ERROR;
+    }
+
+    if (gst_sunxiv4l2_apply_source(v4l2src->v4l2handle) < 0)
+        GST_WARNING_OBJECT(v4l2src, "source timings not applied, the old ones may stay.");
+
+    if (!gst_base_src_negotiate(GST_BASE_SRC(v4l2src))) {
+        GST_ELEMENT_ERROR(v4l2src, CORE, NEGOTIATION, (NULL),
+            ("no caps downstream for %ux%u after the source changed.", width, height));
+        return GST_FLOW_NOT_NEGOTIATED;
+    }
+
+    return GST_FLOW_OK;
+}
+
+static GstFlowReturn
+gst_sunxi_v4l2src_create(GstPushSrc *psrc, GstBuffer **buf)
+{
+    GstSunxiV4l2Src *v4l2src = GST_SUNXI_V4L2SRC(psrc);
+    GstBufferList *list;
+    GstBuffer *next;
+    GstFlowReturn ret;
+    guint n;
+
+    /* an event that ended the last batch */
+    ret = v4l2src->pending_flow;
+    v4l2src->pending_flow = GST_FLOW_OK;
+
+    if (ret == GST_FLOW_OK)
+        ret = gst_sunxi_v4l2src_create_one(v4l2src, buf);
+
+    while (ret == GST_SUNXI_V4L2SRC_FLOW_SOURCE_CHANGE) {
+        ret = gst_sunxi_v4l2src_source_change(v4l2src);
+
+        if (ret == GST_FLOW_OK)
+            ret = gst_sunxi_v4l2src_create_one(v4l2src, buf);
+    }
+
+    if (ret != GST_FLOW_OK || v4l2src->batch_max <= 1)
+        return ret;
+
+    /* take what the driver already has, or gets within the latency bound,
+     * and push it in one go */
+    list = gst_buffer_list_new_sized(v4l2src->batch_max);
+    gst_buffer_list_add(list, *buf);
+    *buf = NULL;
+
+    v4l2src->batch_deadline = g_get_monotonic_time() + v4l2src->batch_latency / GST_USECOND;
+
+    while (gst_buffer_list_length(list) < v4l2src->batch_max) {
+        ret = gst_sunxi_v4l2src_create_one(v4l2src, &next);
+
+        if (ret != GST_FLOW_OK)
+            break;
+
+        gst_buffer_list_add(list, next);
+    }
+
+    v4l2src->batch_deadline = -1;
+
+    if (ret == GST_SUNXI_V4L2SRC_FLOW_SOURCE_CHANGE || ret == GST_FLOW_EOS) {
+        /* push the frames from before it first */
+        v4l2src->pending_flow = ret;
+    } else if (ret != GST_FLOW_OK && ret != GST_FLOW_CUSTOM_SUCCESS) {
+        gst_buffer_list_unref(list);
+        return ret;
+    }
+
+    n = gst_buffer_list_length(list);
+
+    if (n == 1) {
+        *buf = gst_buffer_ref(gst_buffer_list_get(list, 0));
+        gst_buffer_list_unref(list);
+        return GST_FLOW_OK;
+    }
+
+    GST_LOG_OBJECT(v4l2src, "push %u frames in one list", n);
+
+    v4l2src->batches++;
+    v4l2src->batched += n;
+
+    gst_base_src_submit_buffer_list(GST_BASE_SRC(v4l2src), list);
+
+    return GST_FLOW_OK;
+}
+
+static gboolean
+gst_sunxiv4l2src_unlock(GstBaseSrc *bsrc)
+{
+    GstSunxiV4l2Src *v4l2src = GST_SUNXI_V4L2SRC(bsrc);
+
+    g_atomic_int_set(&v4l2src->unlocked, TRUE);
+
+    return TRUE;
+}
+
+static gboolean
+gst_sunxiv4l2src_unlock_stop(GstBaseSrc *bsrc)
+{
+    GstSunxiV4l2Src *v4l2src = GST_SUNXI_V4L2SRC(bsrc);
+
+    g_atomic_int_set(&v4l2src->unlocked, FALSE);
+
+    return TRUE;
+}
+
+static gpointer
+gst_sunxi_v4l2src_idle_loop(gpointer data)
+{
+    GstSunxiV4l2Src *v4l2src = GST_SUNXI_V4L2SRC(data);
+    GstSunxiV4l2SrcSched orig = { 0, };
+    gint ret;
+
+    GST_DEBUG_OBJECT(v4l2src, "keep streaming while paused");
+
+    gst_sunxi_v4l2src_apply_scheduling(v4l2src, &orig);
+
+    while (g_atomic_int_get(&v4l2src->idle_running)) {
+        ret = gst_sunxiv4l2_camera_poll(v4l2src->v4l2handle, CAPTURE_POLL_TIMEOUT_MS);
+
+        if (ret == 0)
+            continue;
+
+        if (ret > 0 && !(ret & GST_SUNXI_V4L2_POLL_FRAME)) {
+            /* the streaming thread handles events once it runs again */
+            g_usleep(CAPTURE_POLL_TIMEOUT_MS * 1000);
+            continue;
+        }
+
+        if (ret < 0 || gst_sunxiv4l2_camera_recycle(v4l2src->v4l2handle) < 0) {
+            GST_WARNING_OBJECT(v4l2src, "recycling buffers failed, stop idle streaming.");
+            break;
+        }
+
+        v4l2src->idle_recycled++;
+    }
+
+    GST_DEBUG_OBJECT(v4l2src, "idle streaming stopped, %" G_GUINT64_FORMAT " frames recycled",
+        v4l2src->idle_recycled);
+
+    gst_sunxi_v4l2src_restore_scheduling(v4l2src, &orig);
+
+    return NULL;
+}
+
+static void
+gst_sunxi_v4l2src_idle_start(GstSunxiV4l2Src *v4l2src)
+{
+    if (!v4l2src->keep_streaming || !v4l2src->stream_on || v4l2src->idle_thread)
+        return;
+
+    g_atomic_int_set(&v4l2src->idle_running, TRUE);
+    v4l2src->idle_thread = g_thread_new("sunxiv4l2src-idle", gst_sunxi_v4l2src_idle_loop, v4l2src);
+}
+
+static void
+gst_sunxi_v4l2src_idle_stop(GstSunxiV4l2Src *v4l2src)
+{
+    if (!v4l2src->idle_thread)
+        return;
+
+    g_atomic_int_set(&v4l2src->idle_running, FALSE);
+    g_thread_join(v4l2src->idle_thread);
+    v4l2src->idle_thread = NULL;
+
+    /* frames recycled while paused are not lost frames */
+    v4l2src->offset = 0;
+}
+
+static GstPad *
+gst_sunxiv4l2src_request_new_pad(GstElement *element, GstPadTemplate *templ,
+                                 const gchar *name, const GstCaps *caps)
+{
+    GstSunxiV4l2Src *v4l2src = GST_SUNXI_V4L2SRC(element);
+    GstPad *pad;
+
+    GST_OBJECT_LOCK(v4l2src);
+
+    if (v4l2src->preview_pad) {
+        GST_OBJECT_UNLOCK(v4l2src);
+        GST_WARNING_OBJECT(v4l2src, "preview pad already requested");
+        return NULL;
+    }
+
+    pad = gst_pad_new_from_template(templ, "preview");
+    gst_pad_use_fixed_caps(pad);
+    gst_pad_set_activatemode_function(pad, GST_DEBUG_FUNCPTR(gst_sunxi_v4l2src_preview_activate_mode));
+    v4l2src->preview_pad = pad;
+    v4l2src->preview_need_events = TRUE;
+
+    GST_OBJECT_UNLOCK(v4l2src);
+
+    /* activated by add_pad when already running */
+    gst_element_add_pad(element, pad);
+
+    return pad;
+}
+
+static void
+gst_sunxiv4l2src_release_pad(GstElement *element, GstPad *pad)
+{
+    GstSunxiV4l2Src *v4l2src = GST_SUNXI_V4L2SRC(element);
+
+    GST_OBJECT_LOCK(v4l2src);
+
+    if (v4l2src->preview_pad == pad)
+        v4l2src->preview_pad = NULL;
+
+    GST_OBJECT_UNLOCK(v4l2src);
+
+    gst_pad_set_active(pad, FALSE);
+    gst_element_remove_pad(element, pad);
+}
+
+static GstStateChangeReturn
+gst_sunxiv4l2src_change_state(GstElement *element, GstStateChange transition)
+{
+    GstSunxiV4l2Src *v4l2src = GST_SUNXI_V4L2SRC(element);
+    GstStateChangeReturn ret;
+
+    switch (transition) {
+        case GST_STATE_CHANGE_PAUSED_TO_PLAYING:
+        case GST_STATE_CHANGE_PAUSED_TO_READY:
+            /* the streaming thread owns DQBUF again from here on */
+            gst_sunxi_v4l2src_idle_stop(v4l2src);
+            break;
+        default:
+            break;
+    }
+
+    ret = GST_ELEMENT_CLASS(parent_class)->change_state(element, transition);
+
+    if (ret == GST_STATE_CHANGE_FAILURE)
+        return ret;
+
+    switch (transition) {
+        case GST_STATE_CHANGE_PLAYING_TO_PAUSED:
+            /* basesrc has parked the streaming thread, keep the VIN
+             * and the ISP 3A running by recycling buffers ourselves */
+            gst_sunxi_v4l2src_idle_start(v4l2src);
+            break;
+        case GST_STATE_CHANGE_PAUSED_TO_READY:
+            /* the pads are deactivated, the preview task is gone */
+            gst_sunxi_v4l2src_preview_reset(v4l2src);
+            break;
+        default:
+            break;
+    }
+
     return ret;
 }
 
@@ -552,6 +3320,42 @@ gst_sunxiv4l2src_start(GstBaseSrc *bsrc)
     }
 
     v4l2src->v4l2handle = v4l2handle;
+    gst_sunxiv4l2_subscribe_events(v4l2handle);
+
+    v4l2src->idle_recycled = 0;
+    v4l2src->copied = 0;
+    v4l2src->stale_dropped = 0;
+    v4l2src->stale_pending = 0;
+    v4l2src->decimated = 0;
+    v4l2src->static_suppressed = 0;
+    v4l2src->batches = 0;
+    v4l2src->batched = 0;
+    v4l2src->pll_locked = FALSE;
+    v4l2src->latency_window_max = 0;
+    v4l2src->latency_window_frames = 0;
+    v4l2src->capture_latency = 0;
+    v4l2src->smooth_valid = FALSE;
+    v4l2src->smooth_resyncs = 0;
+    v4l2src->qos_factor = 1;
+    v4l2src->qos_proportion = 1.0;
+    v4l2src->qos_changed = 0;
+    v4l2src->qos_decimated = 0;
+    v4l2src->error_frames = 0;
+    v4l2src->offset_resync = FALSE;
+    v4l2src->recoveries = 0;
+    v4l2src->recovery_failures = 0;
+    v4l2src->corrupt_frames = 0;
+    v4l2src->pending_flow = GST_FLOW_OK;
+    v4l2src->source_width = 0;
+    v4l2src->source_height = 0;
+    v4l2src->source_changes = 0;
+    v4l2src->static_pushed = 0;
+    v4l2src->skipped = 0;
+    v4l2src->sched_latency_avg = 0;
+    v4l2src->sched_latency_max = 0;
+    v4l2src->sched_thread = NULL;
+
+    gst_sunxiv4l2_luma_analyzer_reset(v4l2src->luma);
 
     GST_OBJECT_UNLOCK(v4l2src);
 
@@ -563,13 +3367,42 @@ gst_sunxiv4l2src_stop(GstBaseSrc *bsrc)
 {
     GstSunxiV4l2Src *v4l2src = GST_SUNXI_V4L2SRC(bsrc);
 
+    gst_sunxi_v4l2src_idle_stop(v4l2src);
+
+    /* frames downstream outlive the stream, they no longer go back to the
+     * driver and keep the device open until they are freed */
+    if (v4l2src->allocator)
+        gst_sunxi_v4l2_allocator_release(v4l2src->allocator, 0, NULL);
+
+    if (v4l2src->pool) {
+        gst_buffer_pool_set_active(v4l2src->pool, FALSE);
+        gst_object_unref(v4l2src->pool);
+        v4l2src->pool = NULL;
+    }
+
+    if (v4l2src->copy_pool) {
+        gst_buffer_pool_set_active(v4l2src->copy_pool, FALSE);
+        gst_object_unref(v4l2src->copy_pool);
+        v4l2src->copy_pool = NULL;
+    }
+
+    if (v4l2src->allocator) {
+        gst_object_unref(v4l2src->allocator);
+        v4l2src->allocator = NULL;
+    }
+
     if (v4l2src->v4l2handle) {
         if (v4l2src->stream_on)
             gst_sunxi_v4l2_streamoff(v4l2src->v4l2handle);
             
         gst_sunxiv4l2_close_device(v4l2src->v4l2handle);
+        v4l2src->v4l2handle = NULL;
     }
 
+    v4l2src->stream_on = FALSE;
+
+    gst_sunxiv4l2_luma_analyzer_free(v4l2src->luma);
+    v4l2src->luma = NULL;
 
     return TRUE;
 }
@@ -587,12 +3420,17 @@ gst_sunxiv4l2src_decie_allocation(GstBaseSrc *bsrc, GstQuery *query)
     GstStructure *config;
     gboolean update_pool, update_allocator;
     GstVideoInfo vinfo;
-    const GstStructure *structure;
+
+    /* set_caps already resolved the output layout, tensor caps don't parse */
+    memcpy(&vinfo, &v4l2src->out_info, sizeof(vinfo));
+
+    /* without it a software crop has to copy the window out */
+    v4l2src->crop_meta = gst_query_find_allocation_meta(query, GST_VIDEO_CROP_META_API_TYPE, NULL);
+    if (v4l2src->sw_crop && v4l2src->crop_meta)
+        memcpy(&vinfo, &v4l2src->info, sizeof(vinfo));
 
     if (v4l2src->pool) {
         gst_query_parse_allocation(query, &caps, NULL);
-        gst_video_info_init(&vinfo);
-        gst_sunxi_video_info_from_caps(&vinfo, caps);
 
         if (gst_query_get_n_allocation_pools(query) > 0) {
             gst_query_set_nth_allocation_pool(query, 0, v4l2src->pool, vinfo.size, v4l2src->actual_buf_cnt, v4l2src->actual_buf_cnt);
@@ -603,8 +3441,6 @@ gst_sunxiv4l2src_decie_allocation(GstBaseSrc *bsrc, GstQuery *query)
     }
 
     gst_query_parse_allocation(query, &caps, NULL);
-    gst_video_info_init(&vinfo);
-    gst_sunxi_video_info_from_caps(&vinfo, caps);
 
     if (gst_query_get_n_allocation_params(query) > 0) {
         gst_query_parse_nth_allocation_param(query, 0, &allocator, &params);
@@ -647,7 +3483,6 @@ gst_sunxiv4l2src_decie_allocation(GstBaseSrc *bsrc, GstQuery *query)
     }
 
     if (pool == NULL  /*|| v4l2src->use_v4l2_memory == TRUE */) {
-        GstVideoInfo info;
         if (pool) {
             gst_object_ref(pool);
             goto skip;
@@ -655,15 +3490,9 @@ gst_sunxiv4l2src_decie_allocation(GstBaseSrc *bsrc, GstQuery *query)
 
         GST_DEBUG("no pool, making new pool");
 
-        structure = gst_caps_get_structure(v4l2src->old_caps, 0);
-
-        if (gst_sunxi_video_info_from_caps(&info, v4l2src->old_caps)) {
-            GST_ERROR_OBJECT(v4l2src, "invalid caps");
-            return FALSE;
-        }
-
-        size = GST_VIDEO_INFO_SIZE(&info);
-        pool = gst_video_buffer_pool_new();
+        size = GST_VIDEO_INFO_SIZE(&vinfo);
+        /* the video pool rejects bayer and tensor caps */
+        pool = v4l2src->video_meta ? gst_video_buffer_pool_new() : gst_buffer_pool_new();
     }
 skip:
     v4l2src->pool = pool;
@@ -674,11 +3503,19 @@ skip:
 
     config = gst_buffer_pool_get_config(pool);
 
-    if (!gst_buffer_pool_config_has_option(config, \
+    if (v4l2src->video_meta && !gst_buffer_pool_config_has_option(config, \
         GST_BUFFER_POOL_OPTION_VIDEO_META)) {
             gst_buffer_pool_config_add_option(config, GST_BUFFER_POOL_OPTION_VIDEO_META);
     }
 
+    /* native frames carry the driver's padding, tell downstream so it can
+     * use them in place instead of copying to its own layout */
+    if (v4l2src->video_meta && !v4l2src->repack &&
+        gst_buffer_pool_has_option(pool, GST_BUFFER_POOL_OPTION_VIDEO_ALIGNMENT)) {
+        gst_buffer_pool_config_add_option(config, GST_BUFFER_POOL_OPTION_VIDEO_ALIGNMENT);
+        gst_buffer_pool_config_set_video_alignment(config, &v4l2src->video_align);
+    }
+
     GST_DEBUG("'config': size:%u, min:%d, max:%d", size, min, max);
 
     gst_buffer_pool_config_set_params(config, caps, size, min, max);
@@ -716,6 +3553,10 @@ gst_sunxi_v4l2src_get_all_caps()
         g_print("Can't get caps from capture devcie, use the default setting.\n");
         g_print("Perhaps haven't capture device.\n");
         caps = gst_sunxiv4l2src_default_caps();
+    } else {
+        /* keep the template in line with what get_caps advertises */
+        caps = gst_sunxi_v4l2src_derive_caps(caps);
+        gst_caps_append(caps, gst_caps_from_string("other/tensors, format=(string)static, num_tensors=(int)1"));
     }
 
     return caps;
@@ -735,6 +3576,241 @@ gst_sunxiv4l2_install_properties(GObjectClass *klass)
                                     g_param_spec_int("index", "index", "capture video index",
                                                       0, 2, 0,
                                                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(klass, PROP_KEEP_STREAMING,
+                                    g_param_spec_boolean("keep-streaming", "keep-streaming",
+                                                      "keep the capture streaming and recycle buffers while paused",
+                                                      DEFAULT_KEEP_STREAMING,
+                                                      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(klass, PROP_STARVATION_THRESHOLD,
+                                    g_param_spec_uint("starvation-threshold", "starvation-threshold",
+                                                      "copy frames to system memory when fewer buffers are queued in the driver (0 = never copy)",
+                                                      0, DEFAULT_FRAMES_IN_V4L2_CAPTURE, DEFAULT_STARVATION_THRESHOLD,
+                                                      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(klass, PROP_DROP_STALE,
+                                    g_param_spec_boolean("drop-stale", "drop-stale",
+                                                      "push only the newest ready frame and requeue older ones",
+                                                      DEFAULT_DROP_STALE,
+                                                      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(klass, PROP_DECIMATE,
+                                    g_param_spec_uint("decimate", "decimate",
+                                                      "push only one of every N captured frames",
+                                                      1, G_MAXUINT, DEFAULT_DECIMATE,
+                                                      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                                                      GST_PARAM_MUTABLE_READY));
+    g_object_class_install_property(klass, PROP_MAX_FRAMERATE,
+                                    gst_param_spec_fraction("max-framerate", "max-framerate",
+                                                      "decimate captured frames down to this rate (0/1 = sensor rate)",
+                                                      0, 1, G_MAXINT, 1, 0, 1,
+                                                      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                                                      GST_PARAM_MUTABLE_READY));
+    g_object_class_install_property(klass, PROP_CPU_AFFINITY,
+                                    g_param_spec_uint("cpu-affinity", "cpu-affinity",
+                                                      "cpu mask for the capture thread (0 = no affinity)",
+                                                      0, G_MAXUINT, DEFAULT_CPU_AFFINITY,
+                                                      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(klass, PROP_RT_PRIORITY,
+                                    g_param_spec_int("rt-priority", "rt-priority",
+                                                      "real-time priority of the capture thread (0 = default scheduling)",
+                                                      0, 99, DEFAULT_RT_PRIORITY,
+                                                      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(klass, PROP_RT_POLICY,
+                                    g_param_spec_enum("rt-policy", "rt-policy",
+                                                      "real-time scheduling policy used with rt-priority",
+                                                      GST_TYPE_SUNXI_V4L2SRC_RT_POLICY, DEFAULT_RT_POLICY,
+                                                      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(klass, PROP_DEVICE_ONLY,
+                                    g_param_spec_boolean("device-only", "device-only",
+                                                      "consumers access frames by DMA only, skip per-frame CPU cache maintenance",
+                                                      DEFAULT_DEVICE_ONLY,
+                                                      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                                                      GST_PARAM_MUTABLE_READY));
+    g_object_class_install_property(klass, PROP_N_THREADS,
+                                    g_param_spec_uint("n-threads", "n-threads",
+                                                      "threads used for frame conversion (0 = number of cpus)",
+                                                      0, SUNXI_V4L2_MAX_WORKERS, DEFAULT_N_THREADS,
+                                                      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+    g_object_class_install_property(klass, PROP_TENSOR_TYPE,
+                                    g_param_spec_enum("tensor-type", "tensor-type",
+                                                      "output planar RGB tensors (other/tensors) instead of video frames",
+                                                      GST_TYPE_SUNXI_V4L2SRC_TENSOR_TYPE, DEFAULT_TENSOR_TYPE,
+                                                      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                                                      GST_PARAM_MUTABLE_READY));
+    g_object_class_install_property(klass, PROP_TENSOR_WIDTH,
+                                    g_param_spec_uint("tensor-width", "tensor-width",
+                                                      "width of the tensor, the frame is resized to it",
+                                                      1, G_MAXUINT16, DEFAULT_TENSOR_WIDTH,
+                                                      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                                                      GST_PARAM_MUTABLE_READY));
+    g_object_class_install_property(klass, PROP_TENSOR_HEIGHT,
+                                    g_param_spec_uint("tensor-height", "tensor-height",
+                                                      "height of the tensor, the frame is resized to it",
+                                                      1, G_MAXUINT16, DEFAULT_TENSOR_HEIGHT,
+                                                      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                                                      GST_PARAM_MUTABLE_READY));
+    g_object_class_install_property(klass, PROP_TENSOR_MEAN,
+                                    gst_param_spec_array("tensor-mean", "tensor-mean",
+                                                      "per channel (R, G, B) value subtracted from the 0-255 samples",
+                                                      g_param_spec_float("mean", "mean", "mean",
+                                                          -G_MAXFLOAT, G_MAXFLOAT, 0.0f,
+                                                          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS),
+                                                      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                                                      GST_PARAM_MUTABLE_READY));
+    g_object_class_install_property(klass, PROP_TENSOR_SCALE,
+                                    gst_param_spec_array("tensor-scale", "tensor-scale",
+                                                      "per channel (R, G, B) factor applied after the mean",
+                                                      g_param_spec_float("scale", "scale", "scale",
+                                                          -G_MAXFLOAT, G_MAXFLOAT, 1.0f,
+                                                          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS),
+                                                      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                                                      GST_PARAM_MUTABLE_READY));
+    g_object_class_install_property(klass, PROP_PREVIEW_SCALE,
+                                    g_param_spec_uint("preview-scale", "preview-scale",
+                                                      "downscale factor of the frames on the preview pad",
+                                                      2, 16, DEFAULT_PREVIEW_SCALE,
+                                                      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                                                      GST_PARAM_MUTABLE_READY));
+    g_object_class_install_property(klass, PROP_PREVIEW_INTERVAL,
+                                    g_param_spec_uint("preview-interval", "preview-interval",
+                                                      "push a preview for 1 of this many frames",
+                                                      1, G_MAXUINT, DEFAULT_PREVIEW_INTERVAL,
+                                                      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                                                      GST_PARAM_MUTABLE_READY));
+    g_object_class_install_property(klass, PROP_LUMA_STATS,
+                                    g_param_spec_boolean("luma-stats", "luma-stats",
+                                                      "attach luma histogram, mean/variance and motion score meta",
+                                                      DEFAULT_LUMA_STATS,
+                                                      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                                                      GST_PARAM_MUTABLE_READY));
+    g_object_class_install_property(klass, PROP_LUMA_STATS_STEP,
+                                    g_param_spec_uint("luma-stats-step", "luma-stats-step",
+                                                      "sample every n-th luma row (and column for the histogram)",
+                                                      1, 64, DEFAULT_LUMA_STATS_STEP,
+                                                      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                                                      GST_PARAM_MUTABLE_READY));
+    g_object_class_install_property(klass, PROP_STATIC_THRESHOLD,
+                                    g_param_spec_uint("static-threshold", "static-threshold",
+                                                      "requeue frames whose 16x16 luma blocks all differ from the last pushed frame by at most this mean level (0 = disabled)",
+                                                      0, 255, DEFAULT_STATIC_THRESHOLD,
+                                                      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                                                      GST_PARAM_MUTABLE_READY));
+    g_object_class_install_property(klass, PROP_STATIC_KEEPALIVE,
+                                    g_param_spec_uint("static-keepalive", "static-keepalive",
+                                                      "push a static frame anyway after this many seconds (0 = never)",
+                                                      0, G_MAXUINT, DEFAULT_STATIC_KEEPALIVE,
+                                                      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                                                      GST_PARAM_MUTABLE_READY));
+    g_object_class_install_property(klass, PROP_CROP_LEFT,
+                                    g_param_spec_uint("crop-left", "crop-left",
+                                                      "pixels to crop at the left of the sensor frame",
+                                                      0, G_MAXINT, DEFAULT_CROP,
+                                                      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                                                      GST_PARAM_MUTABLE_READY));
+    g_object_class_install_property(klass, PROP_CROP_RIGHT,
+                                    g_param_spec_uint("crop-right", "crop-right",
+                                                      "pixels to crop at the right of the sensor frame",
+                                                      0, G_MAXINT, DEFAULT_CROP,
+                                                      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                                                      GST_PARAM_MUTABLE_READY));
+    g_object_class_install_property(klass, PROP_CROP_TOP,
+                                    g_param_spec_uint("crop-top", "crop-top",
+                                                      "pixels to crop at the top of the sensor frame",
+                                                      0, G_MAXINT, DEFAULT_CROP,
+                                                      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                                                      GST_PARAM_MUTABLE_READY));
+    g_object_class_install_property(klass, PROP_CROP_BOTTOM,
+                                    g_param_spec_uint("crop-bottom", "crop-bottom",
+                                                      "pixels to crop at the bottom of the sensor frame",
+                                                      0, G_MAXINT, DEFAULT_CROP,
+                                                      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                                                      GST_PARAM_MUTABLE_READY));
+    g_object_class_install_property(klass, PROP_BATCH_MAX,
+                                    g_param_spec_uint("batch-max", "batch-max",
+                                                      "push up to this many frames per wakeup as one buffer list (1 = one buffer at a time)",
+                                                      1, 64, DEFAULT_BATCH_MAX,
+                                                      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                                                      GST_PARAM_MUTABLE_PLAYING));
+    g_object_class_install_property(klass, PROP_BATCH_LATENCY,
+                                    g_param_spec_uint64("batch-latency", "batch-latency",
+                                                        "nanoseconds to wait for more frames once a batch has started (0 = only frames already captured)",
+                                                        0, GST_SECOND, DEFAULT_BATCH_LATENCY,
+                                                        G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                                                        GST_PARAM_MUTABLE_READY));
+    g_object_class_install_property(klass, PROP_PROVIDE_CLOCK,
+                                    g_param_spec_boolean("provide-clock", "provide-clock",
+                                                         "offer a pipeline clock that runs at the pace of the sensor",
+                                                         DEFAULT_PROVIDE_CLOCK,
+                                                         G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                                                         GST_PARAM_MUTABLE_READY));
+    g_object_class_install_property(klass, PROP_SMOOTH_TIMESTAMPS,
+                                    g_param_spec_boolean("smooth-timestamps", "smooth-timestamps",
+                                                         "lock timestamps to the frame period, lost frames still leave gaps",
+                                                         DEFAULT_SMOOTH_TIMESTAMPS,
+                                                         G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                                                         GST_PARAM_MUTABLE_PLAYING));
+    g_object_class_install_property(klass, PROP_QOS_DECIMATE,
+                                    g_param_spec_boolean("qos-decimate", "qos-decimate",
+                                                         "requeue more frames in the driver while downstream QoS reports overload",
+                                                         DEFAULT_QOS_DECIMATE,
+                                                         G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                                                         GST_PARAM_MUTABLE_PLAYING));
+    g_object_class_install_property(klass, PROP_RECOVERY_ATTEMPTS,
+                                    g_param_spec_uint("recovery-attempts", "recovery-attempts",
+                                                      "stream restarts tried before a capture failure is fatal (0 = none)",
+                                                      0, 100, DEFAULT_RECOVERY_ATTEMPTS,
+                                                      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                                                      GST_PARAM_MUTABLE_PLAYING));
+    g_object_class_install_property(klass, PROP_WATCHDOG_TIMEOUT,
+                                    g_param_spec_uint("watchdog-timeout", "watchdog-timeout",
+                                                      "restart the stream when no frame arrives for this long, in ms (0 = never)",
+                                                      0, G_MAXUINT, DEFAULT_WATCHDOG_TIMEOUT,
+                                                      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+                                                      GST_PARAM_MUTABLE_PLAYING));
+    g_object_class_install_property(klass, PROP_STATS,
+                                    g_param_spec_boxed("stats", "stats", "capture statistics",
+                                                      GST_TYPE_STRUCTURE,
+                                                      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+    g_object_class_override_property(klass, PROP_VIDEO_DIRECTION, "video-direction");
+}
+
+/*
+ * The task posts its stream status from its own thread, leaving is the
+ * last point where the capture thread can undo its scheduling before it
+ * goes back to the pool.
+ */
+static gboolean
+gst_sunxiv4l2src_post_message(GstElement *element, GstMessage *message)
+{
+    GstSunxiV4l2Src *v4l2src = GST_SUNXI_V4L2SRC(element);
+    GstStreamStatusType type;
+    GstElement *owner;
+
+    if (GST_MESSAGE_TYPE(message) == GST_MESSAGE_STREAM_STATUS &&
+        GST_MESSAGE_SRC(message) == GST_OBJECT_CAST(GST_BASE_SRC_PAD(v4l2src))) {
+        gst_message_parse_stream_status(message, &type, &owner);
+
+        if (type == GST_STREAM_STATUS_TYPE_LEAVE) {
+            gst_sunxi_v4l2src_restore_scheduling(v4l2src, v4l2src->sched_orig);
+            v4l2src->sched_thread = NULL;
+        }
+    }
+
+    return GST_ELEMENT_CLASS(parent_class)->post_message(element, message);
+}
+
+static void
+gst_sunxiv4l2src_finalize(GObject *object)
+{
+    GstSunxiV4l2Src *src = GST_SUNXI_V4L2SRC(object);
+
+    g_free(src->sched_orig);
+
+    if (src->clock)
+        gst_object_unref(src->clock);
+
+    g_mutex_clear(&src->preview_lock);
+    g_cond_clear(&src->preview_cond);
+
+    G_OBJECT_CLASS(parent_class)->finalize(object);
 }
 
 static void
@@ -752,19 +3828,32 @@ gst_sunxi_v4l2src_class_init(GstSunxiV4l2SrcClass *klass)
 
     gobject_class->set_property = GST_DEBUG_FUNCPTR(gst_sunxiv4l2src_set_property);
     gobject_class->get_property = GST_DEBUG_FUNCPTR(gst_sunxiv4l2src_get_property);
+    gobject_class->finalize = GST_DEBUG_FUNCPTR(gst_sunxiv4l2src_finalize);
 
     gst_sunxiv4l2_install_properties(gobject_class);
 
+    gstelement_class->change_state = GST_DEBUG_FUNCPTR(gst_sunxiv4l2src_change_state);
+    gstelement_class->request_new_pad = GST_DEBUG_FUNCPTR(gst_sunxiv4l2src_request_new_pad);
+    gstelement_class->release_pad = GST_DEBUG_FUNCPTR(gst_sunxiv4l2src_release_pad);
+    gstelement_class->provide_clock = GST_DEBUG_FUNCPTR(gst_sunxiv4l2src_provide_clock);
+    gstelement_class->post_message = GST_DEBUG_FUNCPTR(gst_sunxiv4l2src_post_message);
+
     gst_element_class_add_pad_template(gstelement_class,
                                        gst_pad_template_new("src", GST_PAD_SRC, GST_PAD_ALWAYS,
                                                             gst_sunxi_v4l2src_get_all_caps()));
+    gst_element_class_add_pad_template(gstelement_class,
+                                       gst_pad_template_new("preview", GST_PAD_SRC, GST_PAD_REQUEST,
+                                                            gst_caps_from_string("video/x-raw, format=(string){ NV12, NV21 }")));
 
     gstbasesrc_class->set_caps = GST_DEBUG_FUNCPTR(gst_sunxiv4l2src_set_caps);
     gstbasesrc_class->get_caps = GST_DEBUG_FUNCPTR(gst_sunxiv4l2src_get_caps);
     gstbasesrc_class->fixate = GST_DEBUG_FUNCPTR(gst_sunxiv4l2src_fixate);
     gstbasesrc_class->query = GST_DEBUG_FUNCPTR(gst_sunxiv4l2src_query);
+    gstbasesrc_class->event = GST_DEBUG_FUNCPTR(gst_sunxiv4l2src_event);
     gstbasesrc_class->start = GST_DEBUG_FUNCPTR(gst_sunxiv4l2src_start);
     gstbasesrc_class->stop = GST_DEBUG_FUNCPTR(gst_sunxiv4l2src_stop);
+    gstbasesrc_class->unlock = GST_DEBUG_FUNCPTR(gst_sunxiv4l2src_unlock);
+    gstbasesrc_class->unlock_stop = GST_DEBUG_FUNCPTR(gst_sunxiv4l2src_unlock_stop);
     gstbasesrc_class->decide_allocation = GST_DEBUG_FUNCPTR(gst_sunxiv4l2src_decie_allocation);
 
     gstpushsrc_class->create = GST_DEBUG_FUNCPTR(gst_sunxi_v4l2src_create);
@@ -789,8 +3878,54 @@ gst_sunxi_v4l2src_init(GstSunxiV4l2Src *src)
     src->info.width = DEFAULT_WIDTH;
     src->info.height = DEFAULT_HEIGHT;
     src->info.size = DEFAULT_SIZE;
+    memcpy(&src->out_info, &src->info, sizeof(GstVideoInfo));
+    src->sensor_width = DEFAULT_WIDTH;
+    src->sensor_height = DEFAULT_HEIGHT;
     src->v4l2handle = NULL;
     src->io_mode = V4L2_MEMORY_MMAP;
+    src->keep_streaming = DEFAULT_KEEP_STREAMING;
+    src->starvation_threshold = DEFAULT_STARVATION_THRESHOLD;
+    src->drop_stale = DEFAULT_DROP_STALE;
+    src->decimate = DEFAULT_DECIMATE;
+    src->max_fps_n = 0;
+    src->max_fps_d = 1;
+    src->decimation = 1;
+    src->cpu_affinity = DEFAULT_CPU_AFFINITY;
+    src->rt_priority = DEFAULT_RT_PRIORITY;
+    src->rt_policy = DEFAULT_RT_POLICY;
+    src->sched_orig = g_new0(GstSunxiV4l2SrcSched, 1);
+    src->device_only = DEFAULT_DEVICE_ONLY;
+    src->n_threads = DEFAULT_N_THREADS;
+    src->tensor.type = DEFAULT_TENSOR_TYPE;
+    src->tensor.width = DEFAULT_TENSOR_WIDTH;
+    src->tensor.height = DEFAULT_TENSOR_HEIGHT;
+    src->tensor.mean[0] = src->tensor.mean[1] = src->tensor.mean[2] = 0.0f;
+    src->tensor.scale[0] = src->tensor.scale[1] = src->tensor.scale[2] = 1.0f;
+    src->preview_scale = DEFAULT_PREVIEW_SCALE;
+    src->preview_interval = DEFAULT_PREVIEW_INTERVAL;
+    src->luma_stats = DEFAULT_LUMA_STATS;
+    src->luma_step = DEFAULT_LUMA_STATS_STEP;
+    src->static_threshold = DEFAULT_STATIC_THRESHOLD;
+    src->static_keepalive = DEFAULT_STATIC_KEEPALIVE;
+    src->batch_max = DEFAULT_BATCH_MAX;
+    src->batch_latency = DEFAULT_BATCH_LATENCY;
+    src->batch_deadline = -1;
+    src->provide_clock = DEFAULT_PROVIDE_CLOCK;
+    src->smooth_timestamps = DEFAULT_SMOOTH_TIMESTAMPS;
+    src->qos_decimate = DEFAULT_QOS_DECIMATE;
+    src->qos_factor = 1;
+    src->recovery_attempts = DEFAULT_RECOVERY_ATTEMPTS;
+    src->watchdog_timeout = DEFAULT_WATCHDOG_TIMEOUT;
+    src->crop_left = src->crop_right = DEFAULT_CROP;
+    src->crop_top = src->crop_bottom = DEFAULT_CROP;
+    src->direction = DEFAULT_VIDEO_DIRECTION;
+
+    g_mutex_init(&src->preview_lock);
+    g_cond_init(&src->preview_cond);
+
+    gst_pad_add_probe(GST_BASE_SRC_PAD(src),
+        GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM | GST_PAD_PROBE_TYPE_EVENT_FLUSH,
+        gst_sunxi_v4l2src_preview_forward, src, NULL);
 
     gst_fmt = gst_video_format_from_string(DEFAULT_FORMAT);
 
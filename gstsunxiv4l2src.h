@@ -7,6 +7,11 @@
 #include <gst/base/gstpushsrc.h>
 #include <gst/video/gstvideopool.h>
 #include <gst/video/gstvideometa.h>
+#include <gst/video/video.h>
+#include <gst/video/videodirection.h>
+
+#include "gstsunxiv4l2.h"
+#include "gstsunxiv4l2convert.h"
 
 G_BEGIN_DECLS
 
@@ -35,9 +40,42 @@ G_BEGIN_DECLS
 #define DEFAULT_DEVICE "/dev/video0"
 
 #define DEFAULT_FRAMES_IN_V4L2_CAPTURE 3
+#define DEFAULT_KEEP_STREAMING FALSE
+#define DEFAULT_STARVATION_THRESHOLD 0
+#define DEFAULT_DROP_STALE FALSE
+#define DEFAULT_DECIMATE 1
+#define DEFAULT_CPU_AFFINITY 0
+#define DEFAULT_RT_PRIORITY 0
+#define DEFAULT_RT_POLICY GST_SUNXI_V4L2SRC_RT_POLICY_FIFO
+#define DEFAULT_DEVICE_ONLY FALSE
+#define DEFAULT_N_THREADS 0
+#define DEFAULT_TENSOR_TYPE GST_SUNXI_TENSOR_NONE
+#define DEFAULT_TENSOR_WIDTH 224
+#define DEFAULT_TENSOR_HEIGHT 224
+#define DEFAULT_PREVIEW_SCALE 4
+#define DEFAULT_PREVIEW_INTERVAL 1
+#define DEFAULT_LUMA_STATS FALSE
+#define DEFAULT_LUMA_STATS_STEP 4
+#define DEFAULT_STATIC_THRESHOLD 0
+#define DEFAULT_STATIC_KEEPALIVE 10
+#define DEFAULT_CROP 0
+#define DEFAULT_VIDEO_DIRECTION GST_VIDEO_ORIENTATION_IDENTITY
+#define DEFAULT_BATCH_MAX 1
+#define DEFAULT_BATCH_LATENCY 0
+#define DEFAULT_PROVIDE_CLOCK FALSE
+#define DEFAULT_SMOOTH_TIMESTAMPS FALSE
+#define DEFAULT_QOS_DECIMATE FALSE
+#define DEFAULT_RECOVERY_ATTEMPTS 5
+#define DEFAULT_WATCHDOG_TIMEOUT 1000
+
+typedef enum {
+    GST_SUNXI_V4L2SRC_RT_POLICY_FIFO,
+    GST_SUNXI_V4L2SRC_RT_POLICY_RR,
+} GstSunxiV4l2SrcRtPolicy;
 
 typedef struct _GstSunxiV4l2Src GstSunxiV4l2Src;
 typedef struct _GstSunxiV4l2SrcClass GstSunxiV4l2SrcClass;
+typedef struct _GstSunxiV4l2SrcSched GstSunxiV4l2SrcSched;
 
 
 struct _GstSunxiV4l2Src {
@@ -60,6 +98,112 @@ struct _GstSunxiV4l2Src {
     GstVideoAlignment video_align;
     GstBufferPool *pool;
     GstAllocator *allocator;
+    gint unlocked;
+    gboolean keep_streaming;
+    GThread *idle_thread;
+    gint idle_running;
+    guint64 idle_recycled;
+    guint starvation_threshold;
+    GstBufferPool *copy_pool;
+    guint64 copied;
+    gboolean drop_stale;
+    guint stale_pending;
+    guint64 stale_dropped;
+    guint decimate;
+    gint max_fps_n;
+    gint max_fps_d;
+    guint decimation;
+    guint decimate_phase;
+    guint64 decimated;
+    guint skipped;
+    guint cpu_affinity;
+    gint rt_priority;
+    GstSunxiV4l2SrcRtPolicy rt_policy;
+    GThread *sched_thread;
+    GstSunxiV4l2SrcSched *sched_orig;
+    GstClockTime sched_latency_avg;
+    GstClockTime sched_latency_max;
+    gboolean device_only;
+    GstVideoInfo out_info;
+    gboolean repack;
+    guint n_threads;
+    gboolean bayer;
+    GstSunxiBayerFormat bayer_fmt;
+    GstSunxiTensorParams tensor;
+    gboolean tensor_out;
+    gboolean video_meta;
+    GstPad *preview_pad;
+    guint preview_scale;
+    guint preview_interval;
+    guint preview_phase;
+    gboolean preview_need_events;
+    GstVideoInfo preview_info;
+    GstBufferPool *preview_pool;
+    GstBuffer *preview_pending;     /* downscaled, waiting for the frame's timestamp */
+    GMutex preview_lock;
+    GCond preview_cond;
+    GstBuffer *preview_queued;      /* handed to the preview task */
+    gboolean preview_pushing;
+    gboolean preview_eos;
+    gboolean preview_flushing;
+    gboolean luma_stats;
+    guint luma_step;
+    GstSunxiLumaAnalyzer *luma;
+    guint static_threshold;
+    guint static_keepalive;
+    gint64 static_pushed;
+    guint64 static_suppressed;
+    guint crop_left;
+    guint crop_right;
+    guint crop_top;
+    guint crop_bottom;
+    guint sensor_width;
+    guint sensor_height;
+    struct v4l2_rect crop;
+    gboolean hw_crop;
+    gboolean sw_crop;
+    gboolean crop_meta;
+    GstVideoOrientationMethod direction;
+    gboolean sw_hflip;
+    gboolean sw_vflip;
+    guint batch_max;
+    GstClockTime batch_latency;
+    gint64 batch_deadline;
+    guint64 batches;
+    guint64 batched;
+    gboolean provide_clock;
+    GstClock *clock;
+    gboolean pll_locked;
+    guint32 pll_sequence;
+    GstClockTime pll_origin;    /* monotonic time the loop state is relative to */
+    GstClockTime pll_external;  /* clock time of the last frame */
+    gdouble pll_t0;             /* filtered time of the last frame */
+    gdouble pll_t1;             /* predicted time of the next frame */
+    gdouble pll_period;         /* filtered frame period */
+    GstClockTime latency_window_max;
+    guint latency_window_frames;
+    GstClockTime capture_latency;   /* measured capture to push, 0 until known */
+    gboolean smooth_timestamps;
+    gboolean smooth_valid;
+    GstClockTime smooth_pts;
+    guint64 smooth_offset;
+    guint64 smooth_resyncs;
+    gboolean qos_decimate;
+    gint qos_factor;            /* extra decimation downstream asked for */
+    gdouble qos_proportion;
+    gint64 qos_changed;
+    guint64 qos_decimated;
+    guint recovery_attempts;    /* stream restarts per failure, 0 to fail at once */
+    guint watchdog_timeout;     /* ms without a frame before a restart, 0 for none */
+    guint error_frames;         /* corrupt frames in a row */
+    gboolean offset_resync;     /* sequence restarted, continue offsets from it */
+    guint64 recoveries;
+    guint64 recovery_failures;
+    guint64 corrupt_frames;
+    GstFlowReturn pending_flow;     /* event that cut a batch short */
+    guint source_width;             /* size the source last changed to, 0 until then */
+    guint source_height;
+    guint64 source_changes;
 };
 
 struct _GstSunxiV4l2SrcClass {
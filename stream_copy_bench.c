@@ -0,0 +1,358 @@
+/*
+ * Frame copy throughput of gst_sunxiv4l2_stream_copy() against memcpy at
+ * 720p, 1080p and 4K NV12.
+ *
+ * The x86 MOVNTDQA loops the element used to carry are kept here, built
+ * with target attributes and picked by what the cpu supports, so the
+ * numbers that dropped them can be reproduced. On ARM the shipped copy is
+ * the NEON loop.
+ *
+ * Capture buffers are often uncached or write-combined, which cached
+ * system memory doesn't show. Where /dev/dma_heap/system-uncached exists
+ * every copy is timed again with the source in such a buffer.
+ *
+ *   make bench
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#if defined(__has_include)
+#if __has_include(<linux/dma-heap.h>)
+#include <linux/dma-heap.h>
+#define HAVE_DMA_HEAP 1
+#endif
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_X86_VARIANTS 1
+#endif
+
+#include "gstsunxiv4l2simd.h"
+
+#define PREFETCH_DISTANCE 256
+#define RUNS 5
+#define BYTES_PER_RUN (256u << 20)
+#define UNCACHED_BYTES_PER_RUN (16u << 20)  /* uncached reads crawl */
+#define UNCACHED_HEAP "/dev/dma_heap/system-uncached"
+
+typedef void (*CopyFunc)(guint8 *d, const guint8 *s, gsize size);
+
+typedef struct {
+    const gchar *name;
+    CopyFunc func;
+} CopyVariant;
+
+typedef struct {
+    const gchar *name;
+    guint width;
+    guint height;
+} FrameSize;
+
+static void
+copy_memcpy(guint8 *d, const guint8 *s, gsize size)
+{
+    memcpy(d, s, size);
+}
+
+static void
+copy_stream(guint8 *d, const guint8 *s, gsize size)
+{
+    gst_sunxiv4l2_stream_copy(d, s, size);
+}
+
+#ifdef HAVE_X86_VARIANTS
+static gsize
+copy_head(guint8 *d, const guint8 *s, gsize size, guintptr align)
+{
+    gsize head = (align - ((guintptr)s & (align - 1))) & (align - 1);
+
+    head = MIN(head, size);
+    memcpy(d, s, head);
+
+    return head;
+}
+
+__attribute__((target("sse2")))
+static void
+copy_sse2(guint8 *d, const guint8 *s, gsize size)
+{
+    gsize head = copy_head(d, s, size, 16);
+
+    d += head;
+    s += head;
+    size -= head;
+
+    while (size >= 64) {
+        __m128i a, b, c, e;
+
+        __builtin_prefetch(s + PREFETCH_DISTANCE);
+        a = _mm_load_si128((const __m128i *)(s));
+        b = _mm_load_si128((const __m128i *)(s + 16));
+        c = _mm_load_si128((const __m128i *)(s + 32));
+        e = _mm_load_si128((const __m128i *)(s + 48));
+        _mm_storeu_si128((__m128i *)(d), a);
+        _mm_storeu_si128((__m128i *)(d + 16), b);
+        _mm_storeu_si128((__m128i *)(d + 32), c);
+        _mm_storeu_si128((__m128i *)(d + 48), e);
+
+        s += 64;
+        d += 64;
+        size -= 64;
+    }
+
+    memcpy(d, s, size);
+}
+
+__attribute__((target("sse4.1")))
+static void
+copy_sse41(guint8 *d, const guint8 *s, gsize size)
+{
+    gsize head = copy_head(d, s, size, 16);
+
+    d += head;
+    s += head;
+    size -= head;
+
+    while (size >= 64) {
+        __m128i a, b, c, e;
+
+        __builtin_prefetch(s + PREFETCH_DISTANCE);
+        a = _mm_stream_load_si128((__m128i *)(s));
+        b = _mm_stream_load_si128((__m128i *)(s + 16));
+        c = _mm_stream_load_si128((__m128i *)(s + 32));
+        e = _mm_stream_load_si128((__m128i *)(s + 48));
+        _mm_storeu_si128((__m128i *)(d), a);
+        _mm_storeu_si128((__m128i *)(d + 16), b);
+        _mm_storeu_si128((__m128i *)(d + 32), c);
+        _mm_storeu_si128((__m128i *)(d + 48), e);
+
+        s += 64;
+        d += 64;
+        size -= 64;
+    }
+
+    memcpy(d, s, size);
+}
+
+__attribute__((target("avx2")))
+static void
+copy_avx2(guint8 *d, const guint8 *s, gsize size)
+{
+    gsize head = copy_head(d, s, size, 32);
+
+    d += head;
+    s += head;
+    size -= head;
+
+    while (size >= 128) {
+        __m256i a, b, c, e;
+
+        __builtin_prefetch(s + PREFETCH_DISTANCE);
+        a = _mm256_stream_load_si256((__m256i *)(s));
+        b = _mm256_stream_load_si256((__m256i *)(s + 32));
+        c = _mm256_stream_load_si256((__m256i *)(s + 64));
+        e = _mm256_stream_load_si256((__m256i *)(s + 96));
+        _mm256_storeu_si256((__m256i *)(d), a);
+        _mm256_storeu_si256((__m256i *)(d + 32), b);
+        _mm256_storeu_si256((__m256i *)(d + 64), c);
+        _mm256_storeu_si256((__m256i *)(d + 96), e);
+
+        s += 128;
+        d += 128;
+        size -= 128;
+    }
+
+    memcpy(d, s, size);
+}
+#endif
+
+static guint
+collect_variants(CopyVariant *variants)
+{
+    guint n = 0;
+
+    variants[n++] = (CopyVariant){ "memcpy", copy_memcpy };
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    variants[n++] = (CopyVariant){ "stream_copy (neon)", copy_stream };
+#else
+    variants[n++] = (CopyVariant){ "stream_copy", copy_stream };
+#endif
+
+#ifdef HAVE_X86_VARIANTS
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("sse2"))
+        variants[n++] = (CopyVariant){ "sse2 loads", copy_sse2 };
+    if (__builtin_cpu_supports("sse4.1"))
+        variants[n++] = (CopyVariant){ "sse4.1 movntdqa", copy_sse41 };
+    if (__builtin_cpu_supports("avx2"))
+        variants[n++] = (CopyVariant){ "avx2 movntdqa", copy_avx2 };
+#endif
+
+    return n;
+}
+
+static gdouble
+now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* best time of a frame copy, FALSE if the copy came out wrong */
+static gboolean
+time_copy(CopyFunc func, guint8 *dst, const guint8 *src, gsize size, gsize bytes_per_run,
+          gdouble *best_us)
+{
+    guint iterations = MAX(bytes_per_run / size, 2);
+    guint run, i;
+    gdouble start, elapsed;
+
+    *best_us = 0;
+
+    for (run = 0; run < RUNS; run++) {
+        start = now_us();
+        for (i = 0; i < iterations; i++) {
+            func(dst, src, size);
+            __asm__ __volatile__("" : : "r"(dst) : "memory");
+        }
+        elapsed = (now_us() - start) / iterations;
+
+        if (run == 0 || elapsed < *best_us)
+            *best_us = elapsed;
+    }
+
+    if (memcmp(dst, src, size))
+        return FALSE;
+
+    /* unaligned head and tail */
+    memset(dst, 0, size);
+    func(dst + 3, src + 5, size - 9);
+
+    return memcmp(dst + 3, src + 5, size - 9) == 0;
+}
+
+/* a write-combined buffer like the VIN's, NULL where the heap is missing */
+static guint8 *
+uncached_alloc(gsize size, gint *fd)
+{
+#ifdef HAVE_DMA_HEAP
+    struct dma_heap_allocation_data alloc;
+    gint heap;
+    void *data;
+
+    heap = open(UNCACHED_HEAP, O_RDWR | O_CLOEXEC);
+    if (heap < 0)
+        return NULL;
+
+    memset(&alloc, 0, sizeof(alloc));
+    alloc.len = size;
+    alloc.fd_flags = O_RDWR | O_CLOEXEC;
+
+    if (ioctl(heap, DMA_HEAP_IOCTL_ALLOC, &alloc) < 0) {
+        close(heap);
+        return NULL;
+    }
+
+    close(heap);
+
+    data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, alloc.fd, 0);
+    if (data == MAP_FAILED) {
+        close(alloc.fd);
+        return NULL;
+    }
+
+    *fd = alloc.fd;
+
+    return data;
+#else
+    return NULL;
+#endif
+}
+
+static void
+uncached_free(guint8 *data, gsize size, gint fd)
+{
+    munmap(data, size);
+    close(fd);
+}
+
+static gboolean
+bench_source(const gchar *source, const CopyVariant *variants, guint n_variants,
+             guint8 *dst, const guint8 *src, gsize size, gsize bytes_per_run)
+{
+    gdouble memcpy_us = 0, us;
+    guint v;
+
+    for (v = 0; v < n_variants; v++) {
+        if (!time_copy(variants[v].func, dst, src, size, bytes_per_run, &us)) {
+            printf("  %-9s %-20s copy mismatch\n", source, variants[v].name);
+            return FALSE;
+        }
+
+        if (v == 0)
+            memcpy_us = us;
+
+        printf("  %-9s %-20s %9.1f us %8.2f GB/s %6.2fx\n", source, variants[v].name,
+            us, size / us / 1e3, memcpy_us / us);
+    }
+
+    return TRUE;
+}
+
+int
+main(void)
+{
+    static const FrameSize sizes[] = {
+        { "720p", 1280, 720 },
+        { "1080p", 1920, 1080 },
+        { "4K", 3840, 2160 },
+    };
+    CopyVariant variants[8];
+    guint n_variants = collect_variants(variants);
+    gboolean ok = TRUE;
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS(sizes); i++) {
+        gsize size = (gsize)sizes[i].width * sizes[i].height * 3 / 2;
+        guint8 *src = aligned_alloc(64, size + 64);
+        guint8 *dst = aligned_alloc(64, size + 64);
+        guint8 *uncached;
+        gsize j;
+        gint fd = -1;
+
+        for (j = 0; j < size + 64; j++)
+            src[j] = j * 131 + 7;
+
+        printf("%s NV12, %" G_GSIZE_FORMAT " bytes, best of %d runs\n", sizes[i].name, size, RUNS);
+
+        ok &= bench_source("cached", variants, n_variants, dst, src, size, BYTES_PER_RUN);
+
+        uncached = uncached_alloc(size + 64, &fd);
+        if (uncached) {
+            memcpy(uncached, src, size + 64);
+            ok &= bench_source("uncached", variants, n_variants, dst, uncached, size,
+                UNCACHED_BYTES_PER_RUN);
+            uncached_free(uncached, size + 64, fd);
+        } else {
+            printf("  uncached  no %s, skipped\n", UNCACHED_HEAP);
+        }
+
+        free(src);
+        free(dst);
+    }
+
+    return ok ? 0 : 1;
+}